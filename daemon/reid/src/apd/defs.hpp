@@ -7,6 +7,8 @@ constexpr const char* kBinaryDir = "/data/adb/ap/bin/";
 constexpr const char* kLogDir = "/data/adb/ap/log/";
 
 constexpr const char* kApRcPath = "/data/adb/ap/.aprc";
+// Counters of the uid-listener packages.list watcher, rewritten after each debounced refresh
+constexpr const char* kUidListenerStatsPath = "/data/adb/ap/.uid_listener_stats";
 constexpr const char* kGlobalNamespaceFile = "/data/adb/.global_namespace_enable";
 constexpr const char* kDaemonPath = "/data/adb/apd";
 
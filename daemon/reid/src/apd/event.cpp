@@ -2,15 +2,19 @@
 
 #include "assets.hpp"
 #include "core/allowlist.hpp"
+#include "core/package_index.hpp"
 #include "defs.hpp"
 #include "log.hpp"
 #include "metamodule.hpp"
 #include "module.hpp"
+#include "package.hpp"
 #include "restorecon.hpp"
 #include "supercall.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
 #include <chrono>
+#include <cinttypes>
 #include <csignal>
 #include <cstdio>
 #include <cstdlib>
@@ -18,6 +22,7 @@
 #include <unistd.h>
 #include <sys/stat.h>
 #include <sys/inotify.h>
+#include <sys/timerfd.h>
 #include <poll.h>
 #include <atomic>
 #include <thread>
@@ -176,6 +181,58 @@ bool OnBootCompleted(const std::string& superkey) {
   return true;
 }
 
+namespace {
+// Trailing debounce for packages.list rewrites: each event pushes the refresh back by
+// kUidDebounceNs, but a steady stream of events cannot delay it past kUidMaxDelayNs.
+constexpr int64_t kUidDebounceNs = 1000000000LL;
+constexpr int64_t kUidMaxDelayNs = 5000000000LL;
+
+struct UidListenerStats {
+  uint64_t events = 0;
+  uint64_t refreshes = 0;
+  uint64_t skipped = 0;
+  int64_t event_ns = 0;
+  int64_t refresh_ns = 0;
+};
+
+int64_t MonotonicNs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+bool ArmTimer(int tfd, int64_t deadline_ns) {
+  struct itimerspec its = {};
+  its.it_value.tv_sec = deadline_ns / 1000000000LL;
+  its.it_value.tv_nsec = deadline_ns % 1000000000LL;
+  return timerfd_settime(tfd, TFD_TIMER_ABSTIME, &its, nullptr) == 0;
+}
+
+void WriteUidListenerStats(const UidListenerStats& stats) {
+  char buf[256];
+  std::snprintf(buf, sizeof(buf),
+                "events=%" PRIu64 "\nrefreshes=%" PRIu64 "\nskipped=%" PRIu64
+                "\nevent_us=%" PRId64 "\nrefresh_us=%" PRId64 "\n",
+                stats.events, stats.refreshes, stats.skipped, stats.event_ns / 1000,
+                stats.refresh_ns / 1000);
+  std::string tmp = std::string(kUidListenerStatsPath) + ".tmp";
+  if (WriteFile(tmp, buf)) {
+    rename(tmp.c_str(), kUidListenerStatsPath);
+  }
+}
+
+// True if any package in package_config was installed, removed or given another UID between
+// the two indexes. Other installs and updates leave the su list and package_config unchanged.
+bool PackageConfigAffected(const ksud::PackageIndex& before, const ksud::PackageIndex& after) {
+  for (const auto& cfg : ReadApPackageConfig()) {
+    if (before.uid_of(cfg.pkg) != after.uid_of(cfg.pkg)) {
+      return true;
+    }
+  }
+  return false;
+}
+}  // namespace
+
 bool StartUidListener() {
   LOGI("start uid listener");
   const std::string superkey = "su";
@@ -186,7 +243,7 @@ bool StartUidListener() {
   std::signal(SIGINT, signal_handler);
   std::signal(SIGPWR, signal_handler);
 
-  int fd = inotify_init1(IN_NONBLOCK);
+  int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
   if (fd < 0) {
     LOGW("inotify init failed");
     return false;
@@ -197,41 +254,78 @@ bool StartUidListener() {
     LOGW("inotify watch failed");
     return false;
   }
+  int tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+  if (tfd < 0) {
+    inotify_rm_watch(fd, wd);
+    close(fd);
+    LOGW("timerfd create failed");
+    return false;
+  }
 
-  bool debounce = false;
-  char buffer[4096] = {0};
+  UidListenerStats stats;
+  auto packages = ksud::package_index();
+  int64_t pending_since = 0;  // first unhandled event, 0 if none
+  alignas(struct inotify_event) char buffer[4096];
   while (true) {
     if (need_refresh.load()) {
       RefreshApPackageList(superkey);
       break;
     }
 
-    struct pollfd pfd = {fd, POLLIN, 0};
-    int pr = poll(&pfd, 1, 1000);
+    struct pollfd pfds[2] = {{fd, POLLIN, 0}, {tfd, POLLIN, 0}};
+    int pr = poll(pfds, 2, 1000);
     if (pr <= 0) {
       continue;
     }
-    ssize_t len = read(fd, buffer, sizeof(buffer));
-    if (len <= 0) {
-      continue;
-    }
-    size_t offset = 0;
-    while (offset < static_cast<size_t>(len)) {
-      auto* ev = reinterpret_cast<struct inotify_event*>(buffer + offset);
-      if (ev->len > 0 && ev->name) {
-        std::string name = ev->name;
-        if (name == "packages.list.tmp" || name == "packages.list") {
-          if (!debounce) {
-            std::this_thread::sleep_for(std::chrono::seconds(1));
-            debounce = true;
-            RefreshApPackageList(superkey);
-            debounce = false;
+
+    if (pfds[0].revents & POLLIN) {
+      int64_t start = MonotonicNs();
+      bool matched = false;
+      ssize_t len;
+      while ((len = read(fd, buffer, sizeof(buffer))) > 0) {
+        size_t offset = 0;
+        while (offset < static_cast<size_t>(len)) {
+          auto* ev = reinterpret_cast<struct inotify_event*>(buffer + offset);
+          if (ev->len > 0 && (std::strcmp(ev->name, "packages.list.tmp") == 0 ||
+                              std::strcmp(ev->name, "packages.list") == 0)) {
+            matched = true;
+            stats.events++;
           }
+          offset += sizeof(struct inotify_event) + ev->len;
         }
       }
-      offset += sizeof(struct inotify_event) + ev->len;
+      if (matched) {
+        int64_t now = MonotonicNs();
+        if (pending_since == 0) {
+          pending_since = now;
+        }
+        if (!ArmTimer(tfd, std::min(now + kUidDebounceNs, pending_since + kUidMaxDelayNs))) {
+          LOGW("timerfd arm failed: %s", strerror(errno));
+        }
+      }
+      stats.event_ns += MonotonicNs() - start;
+    }
+
+    uint64_t expirations = 0;
+    if ((pfds[1].revents & POLLIN) && read(tfd, &expirations, sizeof(expirations)) > 0) {
+      pending_since = 0;
+      int64_t start = MonotonicNs();
+      auto current = ksud::package_index();
+      if (current != packages && PackageConfigAffected(*packages, *current)) {
+        RefreshApPackageList(superkey);
+        stats.refreshes++;
+      } else {
+        stats.skipped++;
+      }
+      packages = current;
+      stats.refresh_ns += MonotonicNs() - start;
+      WriteUidListenerStats(stats);
+      LOGI("uid listener: %" PRIu64 " events, %" PRIu64 " refreshes, %" PRIu64
+           " skipped, %" PRId64 " ms refreshing",
+           stats.events, stats.refreshes, stats.skipped, stats.refresh_ns / 1000000);
     }
   }
+  close(tfd);
   inotify_rm_watch(fd, wd);
   close(fd);
   return true;
@@ -4,10 +4,12 @@
 #include "package.hpp"
 #include "utils.hpp"
 
+#include <algorithm>
 #include <cstdio>
 #include <cerrno>
 #include <cstring>
 #include <mutex>
+#include <unordered_map>
 #include <sys/syscall.h>
 #include <sys/types.h>
 #include <sys/wait.h>
@@ -30,6 +32,7 @@ constexpr long kSupercallSuGrantUid = 0x1100;
 constexpr long kSupercallSuRevokeUid = 0x1101;
 constexpr long kSupercallSuNums = 0x1102;
 constexpr long kSupercallSuList = 0x1103;
+constexpr long kSupercallSuProfile = 0x1104;
 constexpr long kSupercallSuResetPath = 0x1111;
 constexpr long kSupercallSuGetSafemode = 0x1112;
 
@@ -143,37 +146,89 @@ long ScSuAllowUids(const std::string& key, std::vector<int>& uids) {
                  static_cast<int>(uids.size()));
 }
 
-void RefreshApPackageList(const std::string& key) {
-  static std::mutex mutex;
-  std::lock_guard<std::mutex> lock(mutex);
+long ScSuUidProfile(const std::string& key, int uid, SuProfile& profile) {
+  if (key.empty()) {
+    return -EINVAL;
+  }
+  return syscall(kSupercallNr, key.c_str(), VerAndCmd(kSupercallSuProfile), static_cast<long>(uid),
+                 &profile);
+}
 
+long SyncSuGrants(const std::string& key, const std::vector<SuProfile>& wanted, const char* tag) {
   long num = ScSuUidNums(key);
   if (num < 0) {
-    LOGE("[RefreshApPackageList] get number of UIDs: %ld", num);
-    return;
+    LOGE("[%s] get number of UIDs: %ld", tag, num);
+    return num;
   }
   std::vector<int> uids(static_cast<size_t>(num), 0);
-  long n = ScSuAllowUids(key, uids);
-  if (n < 0) {
-    LOGE("[RefreshApPackageList] get su list: %ld", n);
-    return;
+  if (num > 0) {
+    long n = ScSuAllowUids(key, uids);
+    if (n < 0) {
+      LOGE("[%s] get su list: %ld", tag, n);
+      return n;
+    }
+    uids.resize(static_cast<size_t>(std::min(n, num)));
+  }
+
+  std::unordered_map<int, const SuProfile*> want;
+  want.reserve(wanted.size());
+  for (const auto& profile : wanted) {
+    want[profile.uid] = &profile;
   }
+
+  long calls = 0;
+  size_t revoked = 0, unchanged = 0;
+  std::unordered_map<int, SuProfile> granted;
+  granted.reserve(uids.size());
   for (int uid : uids) {
-    if (uid == 0 || uid == 2000) {
-      LOGW("[RefreshApPackageList] skip critical uid: %d", uid);
+    auto it = want.find(uid);
+    if (it == want.end()) {
+      if (uid == 0 || uid == 2000) {
+        continue;
+      }
+      long rc = ScSuRevokeUid(key, uid);
+      calls++;
+      revoked++;
+      if (rc != 0) {
+        LOGE("[%s] revoke uid %d: %ld", tag, uid, rc);
+      }
+      continue;
+    }
+    // Kernels without the profile query get every wanted UID granted again
+    SuProfile current{};
+    if (ScSuUidProfile(key, uid, current) == 0) {
+      granted[uid] = current;
+    }
+  }
+
+  for (const auto& [uid, profile] : want) {
+    auto it = granted.find(uid);
+    if (it != granted.end() && it->second.to_uid == profile->to_uid &&
+        std::strncmp(it->second.scontext, profile->scontext, sizeof(profile->scontext)) == 0) {
+      unchanged++;
       continue;
     }
-    long rc = ScSuRevokeUid(key, uid);
+    long rc = ScSuGrantUid(key, *profile);
+    calls++;
     if (rc != 0) {
-      LOGE("[RefreshApPackageList] revoke uid %d: %ld", uid, rc);
+      LOGE("[%s] grant uid %d: %ld", tag, uid, rc);
     }
   }
+  LOGI("[%s] su list: %zu granted, %zu revoked, %zu unchanged", tag,
+       want.size() - unchanged, revoked, unchanged);
+  return calls;
+}
+
+void RefreshApPackageList(const std::string& key) {
+  static std::mutex mutex;
+  std::lock_guard<std::mutex> lock(mutex);
 
   if (!SynchronizePackageUid()) {
     LOGE("[RefreshApPackageList] synchronize package uids failed");
   }
 
   auto configs = ReadApPackageConfig();
+  std::vector<SuProfile> wanted;
   for (const auto& cfg : configs) {
     if (cfg.allow == 1 && cfg.exclude == 0) {
       SuProfile profile{};
@@ -181,14 +236,14 @@ void RefreshApPackageList(const std::string& key) {
       profile.to_uid = cfg.to_uid;
       std::string sctx = ToScontext(cfg.sctx);
       std::memcpy(profile.scontext, sctx.c_str(), sctx.size());
-      long result = ScSuGrantUid(key, profile);
-      LOGI("[RefreshApPackageList] Loading %s: %ld", cfg.pkg.c_str(), result);
+      wanted.push_back(profile);
     }
     if (cfg.allow == 0 && cfg.exclude == 1) {
       long result = ScSetApModExclude(key, cfg.uid, 1);
       LOGI("[RefreshApPackageList] Loading exclude %s: %ld", cfg.pkg.c_str(), result);
     }
   }
+  SyncSuGrants(key, wanted, "RefreshApPackageList");
 }
 
 void PrivilegeApdProfile(const std::string& key) {
@@ -22,6 +22,12 @@ int ScKVer(const std::string& key);
 long ScKlog(const std::string& key, const std::string& msg);
 long ScSuUidNums(const std::string& key);
 long ScSuAllowUids(const std::string& key, std::vector<int>& uids);
+long ScSuUidProfile(const std::string& key, int uid, SuProfile& profile);
+
+// Make the kernel su list match `wanted`: grant only new or changed profiles (a grant
+// overwrites in place) and revoke only UIDs no longer wanted, never 0 or 2000. Returns the
+// number of supercalls issued, or a negative error if the current list cannot be read.
+long SyncSuGrants(const std::string& key, const std::vector<SuProfile>& wanted, const char* tag);
 
 void RefreshApPackageList(const std::string& key);
 void PrivilegeApdProfile(const std::string& key);
@@ -127,6 +127,9 @@ int MurasakiBinderService::init() {
 
     LOGI("Initializing Murasaki Binder service...");
 
+    // Every transaction checks the caller against the allowlist
+    allowlist_cache_start();
+
     // Initialize wrapper
     if (!BinderWrapper::instance().init()) {
         LOGE("Failed to initialize Binder wrapper");
@@ -862,14 +865,13 @@ static binder_status_t onTransactKernel(AIBinder* binder, transaction_code_t cod
     case 14: {  // int injectSepolicyBatch(String[] rules)
         int32_t n = 0;
         BW.AParcel_readInt32(in, &n);
-        int32_t ok_count = 0;
+        std::vector<std::string> rules;
         for (int32_t i = 0; i < n; i++) {
             std::string rule;
             BW.readString(in, rule);
-            if (sepolicy_live_patch(rule) == 0) {
-                ok_count++;
-            }
+            rules.push_back(std::move(rule));
         }
+        int32_t ok_count = sepolicy_live_patch_batch(rules);
         WRITE_NO_EXCEPTION();
         BW.AParcel_writeInt32(out, ok_count);
         return STATUS_OK;
@@ -1,4 +1,5 @@
 #include "allowlist.hpp"
+#include "package_index.hpp"
 #include "defs.hpp"
 #include "log.hpp"
 #include "utils.hpp"
@@ -12,13 +13,78 @@
 #endif
 
 #include <algorithm>
+#include <atomic>
 #include <cstdlib>
 #include <cstring>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 namespace ksud {
 
+// Sorted allowlist UIDs, published by allowlist_cache_start()
+struct UidSnapshot {
+    std::vector<int32_t> uids;
+};
+
+static std::atomic<const UidSnapshot*> g_uid_snapshot{nullptr};
+// Lookups in progress. A reader registers before loading the pointer, so a publisher that sees
+// no readers after its swap knows nobody still holds a replaced snapshot.
+static std::atomic<int> g_snapshot_readers{0};
+// Serializes publishers, so the unchanged-content check and the swap cannot interleave
+static std::mutex g_snapshot_mutex;
+// Set while the inotify watch keeps the snapshot current; guarded by g_snapshot_mutex
+static bool g_cache_active = false;
+// Replaced snapshots not yet known to be unreferenced; guarded by g_snapshot_mutex
+static std::vector<std::unique_ptr<const UidSnapshot>> g_retired_snapshots;
+
+// Pins the current snapshot for one lookup; two atomic counter updates, no lock
+class SnapshotReader {
+public:
+    SnapshotReader() { g_snapshot_readers.fetch_add(1); }
+    ~SnapshotReader() { g_snapshot_readers.fetch_sub(1); }
+    const UidSnapshot* get() const { return g_uid_snapshot.load(); }
+};
+
+// Swap in `snap` (may be null) and free every retired snapshot once no lookup is running.
+// Lookups take microseconds and publishes follow user action, so the list stays short.
+static void replace_snapshot(std::unique_ptr<const UidSnapshot> snap) {
+    const UidSnapshot* old = g_uid_snapshot.exchange(snap.release());
+    if (old)
+        g_retired_snapshots.emplace_back(old);
+    if (g_snapshot_readers.load() == 0)
+        g_retired_snapshots.clear();
+}
+
+static std::vector<int32_t> sorted_uids(const std::vector<AllowlistEntry>& entries) {
+    std::vector<int32_t> uids;
+    uids.reserve(entries.size());
+    for (const auto& e : entries)
+        uids.push_back(e.first);
+    std::sort(uids.begin(), uids.end());
+    uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
+    return uids;
+}
+
+static void publish_uids(const std::vector<AllowlistEntry>& entries) {
+    std::vector<int32_t> uids = sorted_uids(entries);
+    std::lock_guard<std::mutex> lock(g_snapshot_mutex);
+    if (!g_cache_active)
+        return;
+    // Our own writes are published before their inotify event arrives; do not publish twice.
+    // Only publishers free snapshots, so the current one can be read under the mutex.
+    const UidSnapshot* current = g_uid_snapshot.load();
+    if (current && current->uids == uids)
+        return;
+    auto snap = std::make_unique<UidSnapshot>();
+    snap->uids = std::move(uids);
+    replace_snapshot(std::move(snap));
+}
+
 std::vector<AllowlistEntry> allowlist_read_unified() {
     std::vector<AllowlistEntry> out;
     auto content = read_file(REI_ALLOWLIST_PATH);
@@ -52,6 +118,8 @@ bool allowlist_write_unified(const std::vector<AllowlistEntry>& entries) {
     }
     if (!write_file(REI_ALLOWLIST_PATH, oss.str()))
         return false;
+    // Our own writes are visible at once, without waiting for the inotify round trip
+    publish_uids(entries);
     allowlist_write_murasaki_allowlist_file();
     return true;
 }
@@ -108,110 +176,135 @@ bool allowlist_remove_by_uid(int32_t uid) {
 }
 
 bool allowlist_contains_uid(int32_t uid) {
+    SnapshotReader reader;
+    if (const UidSnapshot* snap = reader.get())
+        return std::binary_search(snap->uids.begin(), snap->uids.end(), uid);
     auto entries = allowlist_read_unified();
     return std::any_of(entries.begin(), entries.end(),
                        [uid](const AllowlistEntry& e) { return e.first == uid; });
 }
 
 std::vector<int32_t> allowlist_uids() {
-    auto entries = allowlist_read_unified();
-    std::vector<int32_t> uids;
-    uids.reserve(entries.size());
-    for (const auto& e : entries)
-        uids.push_back(e.first);
-    std::sort(uids.begin(), uids.end());
-    uids.erase(std::unique(uids.begin(), uids.end()), uids.end());
-    return uids;
+    {
+        SnapshotReader reader;
+        if (const UidSnapshot* snap = reader.get())
+            return snap->uids;
+    }
+    return sorted_uids(allowlist_read_unified());
 }
 
-std::string allowlist_get_package_for_uid(int32_t uid) {
-    ExecResult r = exec_command({"/system/bin/cmd", "package", "list", "packages", "-U"});
-    if (r.exit_code != 0)
-        return "";
-    auto lines = split(r.stdout_str, '\n');
-    for (const auto& raw : lines) {
-        std::string line = trim(raw);
-        if (line.empty() || !starts_with(line, "package:"))
-            continue;
-        std::string rest = line.substr(8);
-        size_t sp = rest.find(' ');
-        std::string pkg = sp != std::string::npos ? trim(rest.substr(0, sp)) : trim(rest);
-        if (pkg.empty())
-            continue;
-        size_t pos = line.find("uid:");
-        if (pos == std::string::npos)
-            continue;
-        size_t start = line.find(':', pos);
-        if (start == std::string::npos)
-            continue;
-        start++;
-        size_t end = line.find_first_of(" \t\r\n", start);
-        std::string uid_str = (end == std::string::npos) ? line.substr(start) : line.substr(start, end - start);
-        uid_str = trim(uid_str);
-        if (uid_str.empty())
-            continue;
-        if (static_cast<int32_t>(std::strtol(uid_str.c_str(), nullptr, 10)) == uid)
-            return pkg;
+static void watch_allowlist(int fd) {
+    const char* name = strrchr(REI_ALLOWLIST_PATH, '/') + 1;
+    alignas(struct inotify_event) char buf[4096];
+    bool watching = true;
+    while (watching) {
+        ssize_t n = read(fd, buf, sizeof(buf));
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            LOGW("allowlist: inotify read failed: %s", strerror(errno));
+            break;
+        }
+        bool changed = false;
+        for (ssize_t off = 0; off < n;) {
+            auto* ev = reinterpret_cast<const struct inotify_event*>(buf + off);
+            if (ev->mask & IN_Q_OVERFLOW)
+                changed = true;
+            else if (ev->len > 0 && strcmp(ev->name, name) == 0)
+                changed = true;
+            if (ev->mask & IN_IGNORED)
+                watching = false;  // REI_DIR itself went away
+            off += static_cast<ssize_t>(sizeof(struct inotify_event) + ev->len);
+        }
+        if (changed && watching)
+            publish_uids(allowlist_read_unified());
+    }
+
+    // Without a watch the snapshot could go stale; go back to reading the file
+    {
+        std::lock_guard<std::mutex> lock(g_snapshot_mutex);
+        g_cache_active = false;
+        replace_snapshot(nullptr);
     }
-    return "";
+    close(fd);
+    LOGW("allowlist: cache disabled");
 }
 
+void allowlist_cache_start() {
+    static std::once_flag once;
+    std::call_once(once, [] {
+        ensure_dir_exists(REI_DIR);
+        int fd = inotify_init1(IN_CLOEXEC);
+        if (fd < 0 || inotify_add_watch(fd, REI_DIR,
+                                        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM |
+                                            IN_DELETE) < 0) {
+            LOGW("allowlist: cannot watch %s: %s", REI_DIR, strerror(errno));
+            if (fd >= 0)
+                close(fd);
+            return;
+        }
+        // The watch exists before the first read, so no change can slip in between
+        {
+            std::lock_guard<std::mutex> lock(g_snapshot_mutex);
+            g_cache_active = true;
+        }
+        publish_uids(allowlist_read_unified());
+        std::thread(watch_allowlist, fd).detach();
+        LOGI("allowlist: serving UID lookups from memory");
+    });
+}
+
+std::string allowlist_get_package_for_uid(int32_t uid) {
+    // Keep the index alive while its package list is read
+    auto index = package_index();
+    const auto& packages = index->packages_of(uid);
+    return packages.empty() ? "" : packages.front();
+}
+
+static bool ksu_set_allow_su(int32_t uid, const std::string& package, bool allow) {
+    AppProfile p{};
+    memset(&p, 0, sizeof(p));
+    p.version = KSU_APP_PROFILE_VER;
+    strncpy(p.key, package.c_str(), KSU_MAX_PACKAGE_NAME - 1);
+    p.current_uid = uid;
+    p.allow_su = allow ? 1 : 0;
+    return set_app_profile(p) >= 0;
+}
+
+// Only UIDs whose grant differs between the kernel allow list and the unified allowlist are
+// touched, so unchanged apps keep their profile and never lose root mid-sync.
 static void sync_to_ksu(const std::vector<AllowlistEntry>& entries) {
     std::vector<uint32_t> current = get_allow_list(true);
-    if (!current.empty()) {
-        ExecResult r = exec_command({"/system/bin/cmd", "package", "list", "packages", "-U"});
-        if (r.exit_code == 0) {
-            auto lines = split(r.stdout_str, '\n');
-            for (const auto& raw : lines) {
-                std::string line = trim(raw);
-                if (line.empty() || !starts_with(line, "package:"))
-                    continue;
-                std::string rest = line.substr(8);
-                size_t sp = rest.find(' ');
-                if (sp != std::string::npos)
-                    rest = rest.substr(0, sp);
-                std::string pkg = trim(rest);
-                if (pkg.empty())
-                    continue;
-                uint32_t uid = 0;
-                size_t pos = line.find("uid:");
-                if (pos != std::string::npos) {
-                    size_t start = line.find(':', pos);
-                    if (start != std::string::npos) {
-                        start++;
-                        size_t end = line.find_first_of(" \t\r\n", start);
-                        std::string uid_str = (end == std::string::npos)
-                                                  ? line.substr(start)
-                                                  : line.substr(start, end - start);
-                        uid_str = trim(uid_str);
-                        if (!uid_str.empty())
-                            uid = static_cast<uint32_t>(std::strtoul(uid_str.c_str(), nullptr, 10));
-                    }
-                }
-                if (std::find(current.begin(), current.end(), uid) != current.end()) {
-                    AppProfile p{};
-                    memset(&p, 0, sizeof(p));
-                    p.version = KSU_APP_PROFILE_VER;
-                    strncpy(p.key, pkg.c_str(), KSU_MAX_PACKAGE_NAME - 1);
-                    p.current_uid = static_cast<int32_t>(uid);
-                    p.allow_su = 0;
-                    set_app_profile(p);
-                }
-            }
+    std::unordered_set<int32_t> granted(current.begin(), current.end());
+    std::unordered_set<int32_t> wanted;
+    wanted.reserve(entries.size());
+    for (const auto& e : entries)
+        wanted.insert(e.first);
+
+    size_t revoked = 0, grants = 0, skipped = 0;
+    std::shared_ptr<const PackageIndex> index;
+    for (int32_t uid : granted) {
+        if (wanted.count(uid))
+            continue;
+        if (!index)
+            index = package_index();
+        for (const auto& pkg : index->packages_of(uid)) {
+            if (!ksu_set_allow_su(uid, pkg, false))
+                LOGW("allowlist sync ksu: revoke %d %s failed", uid, pkg.c_str());
+            revoked++;
         }
     }
     for (const auto& e : entries) {
-        AppProfile p{};
-        memset(&p, 0, sizeof(p));
-        p.version = KSU_APP_PROFILE_VER;
-        strncpy(p.key, e.second.c_str(), KSU_MAX_PACKAGE_NAME - 1);
-        p.current_uid = e.first;
-        p.allow_su = 1;
-        if (set_app_profile(p) < 0) {
-            LOGW("allowlist sync ksu: set_app_profile %d %s failed", e.first, e.second.c_str());
+        if (granted.count(e.first)) {
+            skipped++;
+            continue;
         }
+        if (!ksu_set_allow_su(e.first, e.second, true))
+            LOGW("allowlist sync ksu: set_app_profile %d %s failed", e.first, e.second.c_str());
+        grants++;
     }
-    LOGI("allowlist sync to KSU: %zu entries", entries.size());
+    LOGI("allowlist sync to KSU: %zu entries, %zu granted, %zu revoked, %zu unchanged",
+         entries.size(), grants, revoked, skipped);
 }
 
 static void sync_to_apatch(const std::vector<AllowlistEntry>& entries) {
@@ -222,32 +315,20 @@ static void sync_to_apatch(const std::vector<AllowlistEntry>& entries) {
         LOGW("allowlist sync apatch: no superkey at %s, skip", REI_SUPERKEY_PATH);
         return;
     }
-    long num = apd::ScSuUidNums(key);
-    if (num > 0) {
-        std::vector<int> uids(static_cast<size_t>(num), 0);
-        long n = apd::ScSuAllowUids(key, uids);
-        if (n > 0) {
-            for (int i = 0; i < n; i++) {
-                int uid = uids[static_cast<size_t>(i)];
-                if (uid == 0 || uid == 2000)
-                    continue;
-                apd::ScSuRevokeUid(key, uid);
-            }
-        }
-    }
-    apd::SuProfile profile{};
-    profile.uid = 0;
-    profile.to_uid = 0;
-    memset(profile.scontext, 0, sizeof(profile.scontext));
-    for (const auto& e : entries) {
-        profile.uid = e.first;
-        profile.to_uid = 0;
-        long ret = apd::ScSuGrantUid(key, profile);
-        if (ret != 0) {
-            LOGW("allowlist sync apatch: ScSuGrantUid %d failed: %ld", e.first, ret);
+    std::vector<apd::SuProfile> wanted(entries.size());
+    for (size_t i = 0; i < entries.size(); i++)
+        wanted[i].uid = entries[i].first;
+    long calls = apd::SyncSuGrants(key, wanted, "allowlist sync apatch");
+    if (calls < 0) {
+        // Current grants unknown: grant everything, as a grant of a granted UID is harmless
+        for (const auto& profile : wanted) {
+            long ret = apd::ScSuGrantUid(key, profile);
+            if (ret != 0)
+                LOGW("allowlist sync apatch: ScSuGrantUid %d failed: %ld", profile.uid, ret);
         }
+        calls = static_cast<long>(wanted.size());
     }
-    LOGI("allowlist sync to APatch: %zu entries", entries.size());
+    LOGI("allowlist sync to APatch: %zu entries, %ld supercalls", entries.size(), calls);
 #else
     (void)entries;
 #endif
@@ -287,13 +368,7 @@ bool allowlist_grant_to_backend(int32_t uid, const std::string& package) {
         return false;
 #endif
     }
-    AppProfile p{};
-    memset(&p, 0, sizeof(p));
-    p.version = KSU_APP_PROFILE_VER;
-    strncpy(p.key, package.c_str(), KSU_MAX_PACKAGE_NAME - 1);
-    p.current_uid = uid;
-    p.allow_su = 1;
-    return set_app_profile(p) >= 0;
+    return ksu_set_allow_su(uid, package, true);
 }
 
 bool allowlist_revoke_from_backend(int32_t uid) {
@@ -310,42 +385,10 @@ bool allowlist_revoke_from_backend(int32_t uid) {
         return false;
 #endif
     }
-    ExecResult r = exec_command({"/system/bin/cmd", "package", "list", "packages", "-U"});
-    if (r.exit_code != 0)
-        return false;
     bool ok = true;
-    auto lines = split(r.stdout_str, '\n');
-    for (const auto& raw : lines) {
-        std::string line = trim(raw);
-        if (line.empty() || !starts_with(line, "package:"))
-            continue;
-        std::string rest = line.substr(8);
-        size_t sp = rest.find(' ');
-        std::string pkg = sp != std::string::npos ? trim(rest.substr(0, sp)) : trim(rest);
-        if (pkg.empty())
-            continue;
-        size_t pos = line.find("uid:");
-        if (pos == std::string::npos)
-            continue;
-        size_t start = line.find(':', pos);
-        if (start == std::string::npos)
-            continue;
-        start++;
-        size_t end = line.find_first_of(" \t\r\n", start);
-        std::string uid_str = (end == std::string::npos) ? line.substr(start) : line.substr(start, end - start);
-        uid_str = trim(uid_str);
-        if (uid_str.empty())
-            continue;
-        int32_t line_uid = static_cast<int32_t>(std::strtol(uid_str.c_str(), nullptr, 10));
-        if (line_uid != uid)
-            continue;
-        AppProfile p{};
-        memset(&p, 0, sizeof(p));
-        p.version = KSU_APP_PROFILE_VER;
-        strncpy(p.key, pkg.c_str(), KSU_MAX_PACKAGE_NAME - 1);
-        p.current_uid = uid;
-        p.allow_su = 0;
-        if (set_app_profile(p) < 0)
+    auto index = package_index();
+    for (const auto& pkg : index->packages_of(uid)) {
+        if (!ksu_set_allow_su(uid, pkg, false))
             ok = false;
     }
     return ok;
@@ -17,6 +17,14 @@ bool allowlist_contains_uid(int32_t uid);
 std::vector<int32_t> allowlist_uids();
 std::string allowlist_get_package_for_uid(int32_t uid);
 
+/**
+ * Serve allowlist_contains_uid() / allowlist_uids() from memory in a long-lived process.
+ * An inotify watch on REI_DIR rebuilds the UID snapshot when the allowlist file content changes
+ * and publishes it with an atomic pointer swap, so lookups neither read the file nor take a lock.
+ * Replaced snapshots are freed by a later publish once no lookup is running.
+ */
+void allowlist_cache_start();
+
 void allowlist_sync_to_backend(const std::string& impl);
 
 /** Write current allowlist UIDs to Murasaki allowlist file under Rei dir (Zygisk/Sui) */
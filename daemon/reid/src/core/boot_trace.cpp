@@ -0,0 +1,312 @@
+#include "boot_trace.hpp"
+#include "../defs.hpp"
+#include "../log.hpp"
+
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <map>
+#include <mutex>
+
+namespace ksud {
+
+struct TraceEvent {
+    std::string name;
+    std::string category;
+    int64_t ts_ns;
+    int64_t dur_ns;
+    pid_t pid;
+    pid_t tid;
+    std::vector<std::pair<std::string, int64_t>> args;
+    pid_t owner = 0;  // thread that ran the span, or waited for the child process
+};
+
+static std::mutex g_trace_mutex;
+static bool g_trace_active = false;
+static std::string g_trace_stage;
+static std::vector<TraceEvent> g_trace_events;
+
+int64_t trace_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000LL + ts.tv_nsec;
+}
+
+static pid_t current_tid() {
+    return static_cast<pid_t>(syscall(SYS_gettid));
+}
+
+static void record_event(TraceEvent ev) {
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    if (g_trace_active)
+        g_trace_events.push_back(std::move(ev));
+}
+
+static std::string json_escape(const std::string& s) {
+    std::string out;
+    out.reserve(s.size());
+    for (char c : s) {
+        if (c == '"' || c == '\\') {
+            out += '\\';
+            out += c;
+        } else if (static_cast<unsigned char>(c) < 0x20) {
+            out += ' ';
+        } else {
+            out += c;
+        }
+    }
+    return out;
+}
+
+// One event per line, fixed key order, so boot_trace_summary() can read it back without a
+// JSON parser. Timestamps are microseconds with nanosecond fractions.
+static std::string format_event(const TraceEvent& ev) {
+    char head[160];
+    snprintf(head, sizeof(head),
+             "{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%" PRId64 ".%03" PRId64
+             ",\"dur\":%" PRId64 ".%03" PRId64 ",\"cat\":\"",
+             ev.pid, ev.tid, ev.ts_ns / 1000, ev.ts_ns % 1000, ev.dur_ns / 1000,
+             ev.dur_ns % 1000);
+    std::string line = head;
+    line += json_escape(ev.category) + "\",\"name\":\"" + json_escape(ev.name) + "\"";
+    if (!ev.args.empty()) {
+        line += ",\"args\":{";
+        for (size_t i = 0; i < ev.args.size(); i++) {
+            if (i > 0)
+                line += ",";
+            line += "\"" + json_escape(ev.args[i].first) +
+                    "\":" + std::to_string(ev.args[i].second);
+        }
+        line += "}";
+    }
+    line += "},\n";
+    return line;
+}
+
+BootTraceSession::BootTraceSession(const char* stage, bool reset) : reset_(reset) {
+    std::lock_guard<std::mutex> lock(g_trace_mutex);
+    g_trace_active = true;
+    g_trace_stage = stage;
+    g_trace_events.clear();
+}
+
+BootTraceSession::~BootTraceSession() {
+    std::vector<TraceEvent> events;
+    std::string stage;
+    {
+        std::lock_guard<std::mutex> lock(g_trace_mutex);
+        g_trace_active = false;
+        events.swap(g_trace_events);
+        stage.swap(g_trace_stage);
+    }
+
+    // The closing ']' is optional in the trace-event array format, which lets every stage
+    // process append to the same file
+    std::string out = reset_ ? "[\n" : "";
+    char meta[128];
+    snprintf(meta, sizeof(meta),
+             "{\"ph\":\"M\",\"pid\":%d,\"name\":\"process_name\",\"args\":{\"name\":\"%s\"}},\n",
+             getpid(), json_escape(stage).c_str());
+    out += meta;
+    for (const auto& ev : events)
+        out += format_event(ev);
+
+    int flags = O_WRONLY | O_CREAT | O_CLOEXEC | (reset_ ? O_TRUNC : O_APPEND);
+    int fd = open(BOOT_TRACE_PATH, flags, 0644);
+    if (fd < 0) {
+        LOGW("Failed to open %s: %s", BOOT_TRACE_PATH, strerror(errno));
+        return;
+    }
+    const char* p = out.data();
+    size_t left = out.size();
+    while (left > 0) {
+        ssize_t n = write(fd, p, left);
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    close(fd);
+    LOGD("Boot trace: %zu events for %s", events.size(), stage.c_str());
+}
+
+void boot_trace_detach() {
+    g_trace_active = false;
+    std::vector<TraceEvent>().swap(g_trace_events);
+    std::string().swap(g_trace_stage);
+}
+
+TraceSpan::TraceSpan(std::string name, const char* category)
+    : name_(std::move(name)), category_(category), start_ns_(trace_now_ns()) {}
+
+TraceSpan::~TraceSpan() {
+    int64_t end = trace_now_ns();
+    record_event({std::move(name_), category_, start_ns_, end - start_ns_, getpid(),
+                  current_tid(), std::move(args_)});
+}
+
+void TraceSpan::arg(const char* key, int64_t value) {
+    args_.emplace_back(key, value);
+}
+
+void trace_child(const std::string& name, pid_t pid, int64_t start_ns,
+                 const struct rusage* usage) {
+    TraceEvent ev{name, "child", start_ns, trace_now_ns() - start_ns, getpid(), pid, {}};
+    ev.args.emplace_back("waiter_tid", current_tid());
+    if (usage) {
+        auto us = [](const struct timeval& tv) {
+            return static_cast<int64_t>(tv.tv_sec) * 1000000 + tv.tv_usec;
+        };
+        ev.args.emplace_back("user_us", us(usage->ru_utime));
+        ev.args.emplace_back("sys_us", us(usage->ru_stime));
+    }
+    record_event(std::move(ev));
+}
+
+// Inverse of format_event() for complete ("X") events; metadata lines are skipped
+static bool parse_event_line(const std::string& line, TraceEvent& ev) {
+    double ts_us = 0, dur_us = 0;
+    int pid = 0, tid = 0;
+    int consumed = 0;
+    if (sscanf(line.c_str(),
+               "{\"ph\":\"X\",\"pid\":%d,\"tid\":%d,\"ts\":%lf,\"dur\":%lf,\"cat\":\"%n", &pid,
+               &tid, &ts_us, &dur_us, &consumed) != 4 ||
+        consumed == 0)
+        return false;
+
+    // Read the two escaped strings that follow: category, then name
+    size_t pos = static_cast<size_t>(consumed);
+    auto read_string = [&](std::string& out) {
+        out.clear();
+        while (pos < line.size() && line[pos] != '"') {
+            if (line[pos] == '\\' && pos + 1 < line.size())
+                pos++;
+            out += line[pos++];
+        }
+        return pos < line.size();
+    };
+    if (!read_string(ev.category))
+        return false;
+    static const char name_key[] = "\",\"name\":\"";
+    if (line.compare(pos, sizeof(name_key) - 1, name_key) != 0)
+        return false;
+    pos += sizeof(name_key) - 1;
+    if (!read_string(ev.name))
+        return false;
+
+    ev.pid = pid;
+    ev.tid = tid;
+    ev.owner = tid;
+    static const char waiter_key[] = "\"waiter_tid\":";
+    auto waiter = line.find(waiter_key, pos);
+    if (waiter != std::string::npos)
+        ev.owner = atoi(line.c_str() + waiter + sizeof(waiter_key) - 1);
+    ev.ts_ns = static_cast<int64_t>(ts_us * 1000.0);
+    ev.dur_ns = static_cast<int64_t>(dur_us * 1000.0);
+    return true;
+}
+
+// Length of the union of [start, end) intervals
+static int64_t covered_ns(std::vector<std::pair<int64_t, int64_t>>& intervals) {
+    std::sort(intervals.begin(), intervals.end());
+    int64_t total = 0, cur_start = 0, cur_end = INT64_MIN;
+    for (const auto& [s, e] : intervals) {
+        if (s > cur_end) {
+            if (cur_end > cur_start)
+                total += cur_end - cur_start;
+            cur_start = s;
+            cur_end = e;
+        } else {
+            cur_end = std::max(cur_end, e);
+        }
+    }
+    if (cur_end > cur_start)
+        total += cur_end - cur_start;
+    return total;
+}
+
+int boot_trace_summary() {
+    std::ifstream ifs(BOOT_TRACE_PATH);
+    if (!ifs) {
+        printf("No boot trace at %s\n", BOOT_TRACE_PATH);
+        return 1;
+    }
+
+    std::vector<TraceEvent> events;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        TraceEvent ev;
+        if (parse_event_line(line, ev))
+            events.push_back(std::move(ev));
+    }
+    if (events.empty()) {
+        printf("Boot trace is empty\n");
+        return 1;
+    }
+
+    // Parent of every event: the innermost enclosing span on the thread that ran it (for child
+    // processes, the thread that waited for them). Spans of worker threads with no such parent
+    // hang off the innermost enclosing span of the stage process' main thread.
+    std::vector<std::vector<std::pair<int64_t, int64_t>>> child_intervals(events.size());
+    for (size_t i = 0; i < events.size(); i++) {
+        const auto& ev = events[i];
+        int64_t end = ev.ts_ns + ev.dur_ns;
+        size_t parent = events.size();
+        int parent_rank = 2;
+        for (size_t j = 0; j < events.size(); j++) {
+            const auto& p = events[j];
+            if (j == i || p.category == "child" || p.pid != ev.pid)
+                continue;
+            if (p.ts_ns > ev.ts_ns || p.ts_ns + p.dur_ns < end)
+                continue;
+            if (p.dur_ns < ev.dur_ns || (p.dur_ns == ev.dur_ns && j > i))
+                continue;
+            int rank = p.tid == ev.owner ? 0 : (p.tid == p.pid ? 1 : 2);
+            if (rank < parent_rank ||
+                (rank == parent_rank && rank < 2 && p.dur_ns < events[parent].dur_ns)) {
+                parent = j;
+                parent_rank = rank;
+            }
+        }
+        if (parent < events.size())
+            child_intervals[parent].emplace_back(ev.ts_ns, end);
+    }
+
+    struct Aggregate {
+        size_t count = 0;
+        int64_t total_ns = 0;
+        int64_t self_ns = 0;
+    };
+    std::map<std::string, Aggregate> by_name;
+    for (size_t i = 0; i < events.size(); i++) {
+        auto& agg = by_name[events[i].category == "child" ? "[child] " + events[i].name
+                                                          : events[i].name];
+        agg.count++;
+        agg.total_ns += events[i].dur_ns;
+        agg.self_ns += events[i].dur_ns - covered_ns(child_intervals[i]);
+    }
+
+    std::vector<std::pair<std::string, Aggregate>> rows(by_name.begin(), by_name.end());
+    std::sort(rows.begin(), rows.end(),
+              [](const auto& a, const auto& b) { return a.second.self_ns > b.second.self_ns; });
+
+    printf("%10s %10s %6s  %s\n", "SELF(ms)", "TOTAL(ms)", "COUNT", "SPAN");
+    for (const auto& [name, agg] : rows) {
+        printf("%10.1f %10.1f %6zu  %s\n", static_cast<double>(agg.self_ns) / 1e6,
+               static_cast<double>(agg.total_ns) / 1e6, agg.count, name.c_str());
+    }
+    printf("\nFull timeline: %s (chrome://tracing or ui.perfetto.dev)\n", BOOT_TRACE_PATH);
+    return 0;
+}
+
+}  // namespace ksud
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct rusage;
+
+namespace ksud {
+
+// Boot timeline tracer.
+// Spans are only recorded while a BootTraceSession is alive. Every stage process appends its
+// events to BOOT_TRACE_PATH in Chrome trace-event format (load it in chrome://tracing or
+// ui.perfetto.dev); the post-fs-data stage starts a fresh file on each boot.
+
+// CLOCK_MONOTONIC in nanoseconds, shared by all stage processes of one boot
+int64_t trace_now_ns();
+
+class BootTraceSession {
+public:
+    // reset: truncate the trace file instead of appending to it
+    BootTraceSession(const char* stage, bool reset);
+    ~BootTraceSession();
+    BootTraceSession(const BootTraceSession&) = delete;
+    BootTraceSession& operator=(const BootTraceSession&) = delete;
+
+private:
+    bool reset_;
+};
+
+// Call in a child right after fork(): stops recording and drops the events inherited from the
+// parent's session, whose destructor never runs in the child. Takes no lock, since another
+// parent thread may have held it at fork time.
+void boot_trace_detach();
+
+// Scoped span; nested spans on the same thread nest in the timeline
+class TraceSpan {
+public:
+    explicit TraceSpan(std::string name, const char* category = "stage");
+    ~TraceSpan();
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+    // Attach a counter shown in the span's args
+    void arg(const char* key, int64_t value);
+
+private:
+    std::string name_;
+    const char* category_;
+    int64_t start_ns_;
+    std::vector<std::pair<std::string, int64_t>> args_;
+};
+
+// Record a reaped child process (script, helper binary) on its own row, with its CPU time
+// from wait4() when usage is given
+void trace_child(const std::string& name, pid_t pid, int64_t start_ns, const struct rusage* usage);
+
+// Print the last boot's spans aggregated by name, sorted by self time (`debug boot-trace`)
+int boot_trace_summary();
+
+}  // namespace ksud
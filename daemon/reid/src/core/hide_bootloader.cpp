@@ -9,6 +9,8 @@
 #include <cstring>
 #include <fstream>
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace ksud {
 
@@ -54,79 +56,6 @@ static const struct {
     {"ro.boot.oem_unlock_support", "0"},
 };
 
-/**
- * Get property value using getprop
- */
-static std::string get_prop(const char* name) {
-    char cmd[256];
-    snprintf(cmd, sizeof(cmd), "getprop %s 2>/dev/null", name);
-
-    FILE* fp = popen(cmd, "r");
-    if (!fp)
-        return "";
-
-    char buf[256] = {0};
-    if (fgets(buf, sizeof(buf), fp)) {
-        // Remove trailing newline
-        size_t len = strlen(buf);
-        if (len > 0 && buf[len - 1] == '\n') {
-            buf[len - 1] = '\0';
-        }
-    }
-    pclose(fp);
-    return std::string(buf);
-}
-
-/**
- * Set property value using resetprop
- * Uses -n to skip init trigger (like Shamiko)
- */
-static bool reset_prop(const char* name, const char* value) {
-    pid_t pid = fork();
-    if (pid < 0) {
-        LOGW("hide_bl: fork failed: %s", strerror(errno));
-        return false;
-    }
-
-    if (pid == 0) {
-        // Child process
-        execl(RESETPROP_PATH, "resetprop", "-n", name, value, nullptr);
-        _exit(127);
-    }
-
-    // Parent: wait for child
-    int status;
-    waitpid(pid, &status, 0);
-    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
-}
-
-/**
- * Check and reset prop if value doesn't match expected
- */
-static void check_reset_prop(const char* name, const char* expected) {
-    std::string value = get_prop(name);
-
-    // Skip if empty (property doesn't exist) or already matches
-    if (value.empty() || value == expected) {
-        return;
-    }
-
-    LOGI("hide_bl: resetting %s from '%s' to '%s'", name, value.c_str(), expected);
-    reset_prop(name, expected);
-}
-
-/**
- * Check if prop contains substring and reset if so
- */
-static void contains_reset_prop(const char* name, const char* contains, const char* newval) {
-    std::string value = get_prop(name);
-
-    if (value.find(contains) != std::string::npos) {
-        LOGI("hide_bl: resetting %s (contains '%s') to '%s'", name, contains, newval);
-        reset_prop(name, newval);
-    }
-}
-
 bool is_bl_hiding_enabled() {
     return access(BL_HIDE_CONFIG, F_OK) == 0;
 }
@@ -166,14 +95,33 @@ static void do_hide_bootloader() {
 
     LOGI("hide_bl: starting bootloader status hiding...");
 
-    // Reset standard properties
+    // One read of all properties, then every mismatch is fixed in one resetprop call
+    PropSnapshot props;
+    std::vector<std::pair<std::string, std::string>> resets;
     for (const auto& prop : PROPS_TO_HIDE) {
-        if (prop.expected != nullptr) {
-            check_reset_prop(prop.name, prop.expected);
-        }
+        if (prop.expected == nullptr)
+            continue;
+        std::string value = props.get_or(prop.name);
+
+        // Skip if empty (property doesn't exist) or already matches
+        if (value.empty() || value == prop.expected)
+            continue;
+        // The table lists a few properties twice
+        bool queued = false;
+        for (const auto& r : resets)
+            queued = queued || r.first == prop.name;
+        if (queued)
+            continue;
+
+        LOGI("hide_bl: resetting %s from '%s' to '%s'", prop.name, value.c_str(), prop.expected);
+        resets.emplace_back(prop.name, prop.expected);
+    }
+
+    if (!resets.empty() && !resetprop_batch(resets)) {
+        LOGW("hide_bl: failed to reset some properties");
     }
 
-    LOGI("hide_bl: bootloader status hiding completed");
+    LOGI("hide_bl: bootloader status hiding completed (%zu reset)", resets.size());
 }
 
 void hide_bootloader_status() {
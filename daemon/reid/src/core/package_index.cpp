@@ -0,0 +1,98 @@
+#include "package_index.hpp"
+#include "../defs.hpp"
+#include "../log.hpp"
+#include "../utils.hpp"
+
+#include <sys/stat.h>
+#include <cstdlib>
+#include <mutex>
+
+namespace ksud {
+
+int32_t PackageIndex::uid_of(const std::string& package) const {
+    auto it = uid_by_package.find(package);
+    return it != uid_by_package.end() ? it->second : -1;
+}
+
+const std::vector<std::string>& PackageIndex::packages_of(int32_t uid) const {
+    static const std::vector<std::string> empty;
+    auto it = packages_by_uid.find(uid);
+    return it != packages_by_uid.end() ? it->second : empty;
+}
+
+static void index_add(PackageIndex& index, std::string package, int32_t uid) {
+    if (package.empty() || !index.uid_by_package.emplace(package, uid).second)
+        return;
+    index.packages_by_uid[uid].push_back(std::move(package));
+}
+
+// packages.list: "<package> <uid> <debuggable> <data dir> <seinfo> <gids> ..."
+static std::shared_ptr<PackageIndex> parse_packages_list(const std::string& content) {
+    auto index = std::make_shared<PackageIndex>();
+    size_t pos = 0;
+    while (pos < content.size()) {
+        size_t eol = content.find('\n', pos);
+        if (eol == std::string::npos)
+            eol = content.size();
+        size_t name_end = content.find(' ', pos);
+        if (name_end != std::string::npos && name_end < eol) {
+            char* end = nullptr;
+            long uid = std::strtol(content.c_str() + name_end + 1, &end, 10);
+            if (end != content.c_str() + name_end + 1)
+                index_add(*index, content.substr(pos, name_end - pos), static_cast<int32_t>(uid));
+        }
+        pos = eol + 1;
+    }
+    return index;
+}
+
+// `cmd package list packages -U`: "package:<package> uid:<uid>"
+static std::shared_ptr<PackageIndex> query_package_manager() {
+    auto index = std::make_shared<PackageIndex>();
+    ExecResult r = exec_command({"/system/bin/cmd", "package", "list", "packages", "-U"});
+    if (r.exit_code != 0) {
+        LOGW("package index: cmd package failed (%d)", r.exit_code);
+        return index;
+    }
+    for (const auto& raw : split(r.stdout_str, '\n')) {
+        std::string line = trim(raw);
+        if (!starts_with(line, "package:"))
+            continue;
+        size_t sp = line.find(' ');
+        size_t uid_pos = line.find("uid:");
+        if (sp == std::string::npos || uid_pos == std::string::npos)
+            continue;
+        int32_t uid = static_cast<int32_t>(std::strtol(line.c_str() + uid_pos + 4, nullptr, 10));
+        index_add(*index, trim(line.substr(8, sp - 8)), uid);
+    }
+    return index;
+}
+
+static std::mutex g_index_mutex;
+static std::shared_ptr<const PackageIndex> g_index;
+static struct stat g_index_stat;
+
+std::shared_ptr<const PackageIndex> package_index() {
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    struct stat st;
+    if (stat(PACKAGES_LIST_PATH, &st) == 0) {
+        // PackageManager replaces the file by rename, so a rewrite always changes the inode
+        if (g_index && st.st_dev == g_index_stat.st_dev && st.st_ino == g_index_stat.st_ino &&
+            st.st_mtim.tv_sec == g_index_stat.st_mtim.tv_sec &&
+            st.st_mtim.tv_nsec == g_index_stat.st_mtim.tv_nsec &&
+            st.st_size == g_index_stat.st_size)
+            return g_index;
+        if (auto content = read_file(PACKAGES_LIST_PATH)) {
+            g_index = parse_packages_list(*content);
+            g_index_stat = st;
+            LOGD("package index: %zu packages from %s", g_index->uid_by_package.size(),
+                 PACKAGES_LIST_PATH);
+            return g_index;
+        }
+    }
+    LOGW("package index: cannot read %s, asking package manager", PACKAGES_LIST_PATH);
+    g_index.reset();
+    return query_package_manager();
+}
+
+}  // namespace ksud
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ksud {
+
+/**
+ * Installed packages by name and by UID. Packages sharing a UID (sharedUserId) are all listed
+ * under it, in packages.list order.
+ */
+struct PackageIndex {
+    std::unordered_map<std::string, int32_t> uid_by_package;
+    std::unordered_map<int32_t, std::vector<std::string>> packages_by_uid;
+
+    // -1 if the package is not installed
+    int32_t uid_of(const std::string& package) const;
+    // Empty if no package has this UID
+    const std::vector<std::string>& packages_of(int32_t uid) const;
+};
+
+/**
+ * Current package index, parsed from /data/system/packages.list and reused while the file keeps
+ * its inode and mtime. Falls back to `cmd package list packages -U` when the file is unreadable.
+ * Never null; the returned index stays valid after later refreshes.
+ */
+std::shared_ptr<const PackageIndex> package_index();
+
+}  // namespace ksud
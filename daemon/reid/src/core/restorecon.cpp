@@ -1,10 +1,25 @@
 #include "restorecon.hpp"
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/xattr.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
 #include <cstring>
+#include <deque>
 #include <filesystem>
+#include <fstream>
+#include <map>
+#include <set>
+#include <mutex>
+#include <sstream>
+#include <thread>
 #include <vector>
 #include "../defs.hpp"
 #include "../log.hpp"
+#include "boot_trace.hpp"
 
 namespace fs = std::filesystem;
 
@@ -21,6 +36,11 @@ bool lsetfilecon(const fs::path& path, const std::string& con) {
     return true;
 }
 
+bool lsetfilecon_at(int dirfd, const std::string& name, const std::string& con) {
+    // There is no *xattrat(); resolve through the dirfd's magic link instead of the full path
+    return lsetfilecon("/proc/self/fd/" + std::to_string(dirfd) + "/" + name, con);
+}
+
 std::string lgetfilecon(const fs::path& path) {
     char buf[256];
     ssize_t len = lgetxattr(path.c_str(), SELINUX_XATTR, buf, sizeof(buf) - 1);
@@ -53,25 +73,243 @@ bool restore_syscon(const fs::path& dir) {
     }
 }
 
-bool restore_syscon_if_unlabeled(const fs::path& dir) {
-    if (!fs::exists(dir)) {
-        return true;
+// Inode and mtime of a skippable subtree. Relabeling only touches ctime, so a walk does not
+// invalidate its own stamps.
+struct DirStamp {
+    uint64_t ino = 0;
+    int64_t mtime_ns = 0;
+
+    bool operator==(const DirStamp& o) const { return ino == o.ino && mtime_ns == o.mtime_ns; }
+};
+
+static constexpr int STAMP_DEPTH = 2;
+
+static std::map<std::string, DirStamp> load_stamps(const char* path) {
+    std::map<std::string, DirStamp> stamps;
+    std::ifstream ifs(path);
+    std::string line;
+    while (std::getline(ifs, line)) {
+        // "<ino> <mtime_ns> <relative path>"
+        std::istringstream iss(line);
+        DirStamp st;
+        std::string rel;
+        if (iss >> st.ino >> st.mtime_ns && iss.get() == ' ' && std::getline(iss, rel))
+            stamps[rel] = st;
     }
+    return stamps;
+}
 
-    try {
-        for (const auto& entry : fs::recursive_directory_iterator(dir)) {
-            std::string con = lgetfilecon(entry.path());
-            if (con.empty() || con == UNLABEL_CON) {
-                if (!lsetfilecon(entry.path(), SYSTEM_CON)) {
-                    LOGW("Failed to restore context for %s", entry.path().c_str());
-                }
+static void save_stamps(const char* path, const std::map<std::string, DirStamp>& stamps) {
+    std::string out;
+    for (const auto& [rel, st] : stamps)
+        out += std::to_string(st.ino) + " " + std::to_string(st.mtime_ns) + " " + rel + "\n";
+    std::string tmp = std::string(path) + ".tmp";
+    std::ofstream ofs(tmp, std::ios::trunc);
+    ofs << out;
+    ofs.close();
+    if (!ofs || rename(tmp.c_str(), path) != 0) {
+        LOGW("Failed to save %s: %s", path, strerror(errno));
+        unlink(tmp.c_str());
+    }
+}
+
+namespace {
+
+struct WalkState {
+    int root_fd;
+    std::string root;
+    const std::map<std::string, DirStamp>* old_stamps;  // null: no incremental walk
+    const std::set<std::string>* skip;                  // relative paths left out, may be null
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<std::pair<std::string, int>> queue;  // relative path, depth below root
+    size_t active = 0;
+    std::map<std::string, DirStamp> new_stamps;
+
+    std::atomic<size_t> visited{0};
+    std::atomic<size_t> relabeled{0};
+    std::atomic<size_t> skipped{0};
+    std::atomic<bool> failed{false};
+};
+
+}  // namespace
+
+// con must be zero-filled before the read, so it is terminated
+static bool is_unlabeled(const char* con, ssize_t len) {
+    return len <= 0 || strcmp(con, UNLABEL_CON) == 0;
+}
+
+// Directories are checked through their own fd
+static void relabel_fd(WalkState& st, int fd, const std::string& rel) {
+    char con[256] = {};
+    ssize_t len = fgetxattr(fd, SELINUX_XATTR, con, sizeof(con) - 1);
+    if (!is_unlabeled(con, len))
+        return;
+    if (fsetxattr(fd, SELINUX_XATTR, SYSTEM_CON, strlen(SYSTEM_CON) + 1, 0) != 0) {
+        LOGW("Failed to restore context for %s/%s: %s", st.root.c_str(), rel.c_str(),
+             strerror(errno));
+        st.failed = true;
+        return;
+    }
+    st.relabeled++;
+}
+
+// Other entries may be symlinks or special files that must not be opened, so they go through
+// the parent's fd link
+static void relabel_at(WalkState& st, int dirfd, const char* name, const std::string& rel) {
+    std::string path = "/proc/self/fd/" + std::to_string(dirfd) + "/" + name;
+    char con[256] = {};
+    ssize_t len = lgetxattr(path.c_str(), SELINUX_XATTR, con, sizeof(con) - 1);
+    if (len < 0 && errno == ENOENT)
+        return;
+    if (!is_unlabeled(con, len))
+        return;
+    if (lsetxattr(path.c_str(), SELINUX_XATTR, SYSTEM_CON, strlen(SYSTEM_CON) + 1, 0) != 0) {
+        // Deleted since readdir (e.g. by a trash purge): nothing left to label
+        if (errno == ENOENT)
+            return;
+        LOGW("Failed to restore context for %s/%s: %s", st.root.c_str(), rel.c_str(),
+             strerror(errno));
+        st.failed = true;
+        return;
+    }
+    st.relabeled++;
+}
+
+static void walk_dir(WalkState& st, const std::string& rel, int depth) {
+    int fd = openat(st.root_fd, rel.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            return;
+        LOGW("Failed to open %s/%s: %s", st.root.c_str(), rel.c_str(), strerror(errno));
+        st.failed = true;
+        return;
+    }
+    // The root itself is not relabeled, only what is below it
+    if (depth > 0)
+        relabel_fd(st, fd, rel);
+
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        st.failed = true;
+        return;
+    }
+
+    std::vector<std::pair<std::string, int>> subdirs;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
+            continue;
+        std::string child = depth > 0 ? rel + "/" + name : name;
+        if (st.skip && st.skip->count(child))
+            continue;
+        st.visited++;
+
+        struct stat sb;
+        bool is_dir = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN && fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) == 0)
+            is_dir = S_ISDIR(sb.st_mode);
+        if (!is_dir) {
+            relabel_at(st, fd, name, child);
+            continue;
+        }
+
+        if (st.old_stamps && depth + 1 == STAMP_DEPTH &&
+            fstatat(fd, name, &sb, AT_SYMLINK_NOFOLLOW) == 0) {
+            DirStamp stamp{static_cast<uint64_t>(sb.st_ino),
+                           static_cast<int64_t>(sb.st_mtim.tv_sec) * 1000000000LL +
+                               sb.st_mtim.tv_nsec};
+            {
+                std::lock_guard<std::mutex> lock(st.mutex);
+                st.new_stamps[child] = stamp;
+            }
+            auto it = st.old_stamps->find(child);
+            if (it != st.old_stamps->end() && it->second == stamp) {
+                st.skipped++;
+                continue;
             }
         }
-        return true;
-    } catch (const fs::filesystem_error& e) {
-        LOGE("Error walking directory %s: %s", dir.c_str(), e.what());
+        subdirs.emplace_back(std::move(child), depth + 1);
+    }
+    closedir(dir);
+
+    if (!subdirs.empty()) {
+        std::lock_guard<std::mutex> lock(st.mutex);
+        for (auto& sub : subdirs)
+            st.queue.push_back(std::move(sub));
+        st.cv.notify_all();
+    }
+}
+
+static void walk_worker(WalkState& st) {
+    std::unique_lock<std::mutex> lock(st.mutex);
+    while (true) {
+        st.cv.wait(lock, [&] { return !st.queue.empty() || st.active == 0; });
+        if (st.queue.empty())
+            return;
+        auto [rel, depth] = std::move(st.queue.front());
+        st.queue.pop_front();
+        st.active++;
+
+        lock.unlock();
+        walk_dir(st, rel, depth);
+        lock.lock();
+
+        st.active--;
+        st.cv.notify_all();
+    }
+}
+
+bool restore_syscon_if_unlabeled(const fs::path& dir, const char* stamp_path,
+                                 RestoreStats* stats, const std::set<std::string>& skip) {
+    int root_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        if (errno == ENOENT)
+            return true;
+        LOGE("Error walking directory %s: %s", dir.c_str(), strerror(errno));
         return false;
     }
+
+    TraceSpan span("restorecon_walk");
+    std::map<std::string, DirStamp> old_stamps;
+    if (stamp_path)
+        old_stamps = load_stamps(stamp_path);
+
+    WalkState st;
+    st.root_fd = root_fd;
+    st.root = dir.string();
+    st.old_stamps = stamp_path ? &old_stamps : nullptr;
+    st.skip = skip.empty() ? nullptr : &skip;
+
+    st.queue.emplace_back(".", 0);
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    std::vector<std::thread> pool;
+    for (long i = 0; i < std::clamp<long>(cpus, 1, 4); i++)
+        pool.emplace_back(walk_worker, std::ref(st));
+    for (auto& t : pool)
+        t.join();
+    close(root_fd);
+
+    if (stamp_path) {
+        // Only a complete walk may vouch for the subtrees it skips next time
+        if (st.failed)
+            unlink(stamp_path);
+        else
+            save_stamps(stamp_path, st.new_stamps);
+    }
+
+    span.arg("visited", static_cast<int64_t>(st.visited));
+    span.arg("relabeled", static_cast<int64_t>(st.relabeled));
+    span.arg("skipped_trees", static_cast<int64_t>(st.skipped));
+    LOGI("restorecon %s: %zu visited, %zu relabeled, %zu subtrees unchanged", dir.c_str(),
+         st.visited.load(), st.relabeled.load(), st.skipped.load());
+    if (stats)
+        *stats = {st.visited, st.relabeled, st.skipped};
+    return !st.failed;
 }
 
 bool restorecon() {
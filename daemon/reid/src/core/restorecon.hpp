@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <filesystem>
+#include <set>
 #include <string>
 
 namespace ksud {
@@ -13,6 +15,9 @@ constexpr const char* UNLABEL_CON = "u:object_r:unlabeled:s0";
 // Set SELinux context for a path
 bool lsetfilecon(const std::filesystem::path& path, const std::string& con);
 
+// Set SELinux context for an entry relative to an open directory (does not follow symlinks)
+bool lsetfilecon_at(int dirfd, const std::string& name, const std::string& con);
+
 // Get SELinux context for a path
 std::string lgetfilecon(const std::filesystem::path& path);
 
@@ -22,8 +27,20 @@ bool setsyscon(const std::filesystem::path& path);
 // Restore system context for directory recursively
 bool restore_syscon(const std::filesystem::path& dir);
 
-// Restore system context if unlabeled
-bool restore_syscon_if_unlabeled(const std::filesystem::path& dir);
+struct RestoreStats {
+    size_t visited = 0;
+    size_t relabeled = 0;
+    size_t skipped_trees = 0;
+};
+
+// Restore system context if unlabeled. Directories are walked by a small thread pool.
+// With stamp_path set, every directory two levels below dir (e.g. modules/<id>) is recorded
+// there by inode and mtime after an error-free walk, and later walks skip those subtrees while
+// their stamp still matches. Paths in skip (relative to dir) are not visited; entries deleted
+// while the walk runs are not an error.
+bool restore_syscon_if_unlabeled(const std::filesystem::path& dir,
+                                 const char* stamp_path = nullptr, RestoreStats* stats = nullptr,
+                                 const std::set<std::string>& skip = {});
 
 // Restore contexts for KSU files
 bool restorecon();
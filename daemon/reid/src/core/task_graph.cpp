@@ -0,0 +1,84 @@
+#include "task_graph.hpp"
+#include "boot_trace.hpp"
+#include "../log.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace ksud {
+
+TaskGraph::TaskId TaskGraph::add(std::string name, std::function<void()> fn,
+                                 std::vector<TaskId> deps) {
+    TaskId id = tasks_.size();
+    Task task;
+    task.name = std::move(name);
+    task.fn = std::move(fn);
+    for (TaskId dep : deps) {
+        if (dep >= id) {
+            LOGE("Task %s depends on unknown task %zu", task.name.c_str(), dep);
+            continue;
+        }
+        tasks_[dep].dependents.push_back(id);
+        task.pending_deps++;
+    }
+    tasks_.push_back(std::move(task));
+    return id;
+}
+
+void TaskGraph::run_task(Task& task) {
+    TraceSpan span(task.name, "task");
+    task.fn();
+}
+
+void TaskGraph::run(unsigned threads) {
+    if (threads <= 1) {
+        // Dependencies always point backwards, so insertion order is a valid schedule
+        for (auto& task : tasks_)
+            run_task(task);
+        return;
+    }
+
+    std::mutex mutex;
+    std::condition_variable cv;
+    std::deque<TaskId> ready;
+    size_t remaining = tasks_.size();
+    for (TaskId id = 0; id < tasks_.size(); id++) {
+        if (tasks_[id].pending_deps == 0)
+            ready.push_back(id);
+    }
+
+    auto worker = [&]() {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (true) {
+            cv.wait(lock, [&] { return !ready.empty() || remaining == 0; });
+            if (ready.empty())
+                return;
+            TaskId id = ready.front();
+            ready.pop_front();
+
+            lock.unlock();
+            run_task(tasks_[id]);
+            lock.lock();
+
+            remaining--;
+            for (TaskId next : tasks_[id].dependents) {
+                if (--tasks_[next].pending_deps == 0)
+                    ready.push_back(next);
+            }
+            cv.notify_all();
+        }
+    };
+
+    // The caller only waits, so its enclosing trace span covers the whole graph
+    size_t count = std::min<size_t>(threads, tasks_.size());
+    std::vector<std::thread> pool;
+    for (size_t i = 0; i < count; i++)
+        pool.emplace_back(worker);
+    for (auto& t : pool)
+        t.join();
+}
+
+}  // namespace ksud
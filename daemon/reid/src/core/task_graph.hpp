@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <string>
+#include <vector>
+
+namespace ksud {
+
+// Small dependency graph of boot steps.
+// A task starts once every task it depends on has finished; independent tasks run concurrently
+// on a bounded set of worker threads. Each task is recorded as a boot trace span.
+class TaskGraph {
+public:
+    using TaskId = size_t;
+
+    // deps must refer to tasks added earlier, which also makes cycles impossible
+    TaskId add(std::string name, std::function<void()> fn, std::vector<TaskId> deps = {});
+
+    // Run all tasks and return when the last one finished. With threads <= 1 tasks run on the
+    // calling thread in insertion order.
+    void run(unsigned threads);
+
+private:
+    struct Task {
+        std::string name;
+        std::function<void()> fn;
+        std::vector<TaskId> dependents;
+        size_t pending_deps = 0;
+    };
+
+    void run_task(Task& task);
+
+    std::vector<Task> tasks_;
+};
+
+}  // namespace ksud
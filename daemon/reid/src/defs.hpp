@@ -16,6 +16,8 @@ constexpr const char* ADB_DIR = "/data/adb/";
 constexpr const char* WORKING_DIR = "/data/adb/ksu/";
 constexpr const char* BINARY_DIR = "/data/adb/ksu/bin/";  // legacy; use active backend or REI_BIN_DIR
 constexpr const char* LOG_DIR = "/data/adb/ksu/log/";
+// Chrome trace-event timeline of the current boot, see core/boot_trace.hpp
+constexpr const char* BOOT_TRACE_PATH = "/data/adb/ksu/log/boot_trace.json";
 
 // 统一 bin：/data/adb/rei/bin 软链接到当前 root 实现的 bin 目录，模块与命令均在此运行
 constexpr const char* REI_BIN_DIR = "/data/adb/rei/bin";
@@ -30,6 +32,8 @@ constexpr const char* BOOTCTL_PATH = "/data/adb/rei/bin/bootctl";
 constexpr const char* PROFILE_DIR = "/data/adb/ksu/profile/";
 constexpr const char* PROFILE_SELINUX_DIR = "/data/adb/ksu/profile/selinux/";
 constexpr const char* PROFILE_TEMPLATE_DIR = "/data/adb/ksu/profile/templates/";
+// Compiled sepolicy patch sets, see sepolicy_apply_compiled()
+constexpr const char* SEPOLICY_CACHE_DIR = "/data/adb/ksu/.sepolicy_cache/";
 
 constexpr const char* KSURC_PATH = "/data/adb/ksu/.ksurc";
 constexpr const char* REID_DAEMON_PATH = "/data/adb/reid";
@@ -45,10 +49,22 @@ constexpr const char* REI_ALLOWLIST_PATH = "/data/adb/rei/allowlist";
 /** Murasaki/Shizuku 白名单：供 Zygisk 桥接模块读取，声明可注入 Binder 的 UID */
 constexpr const char* REI_MURASAKI_ALLOWLIST_PATH = "/data/adb/rei/.murasaki_allowlist";
 constexpr const char* REI_SUPERKEY_PATH = "/data/adb/rei/superkey";
+// Written by PackageManager, one "<package> <uid> ..." line per installed package
+constexpr const char* PACKAGES_LIST_PATH = "/data/system/packages.list";
 
 constexpr const char* MODULE_DIR = "/data/adb/modules/";
 constexpr const char* MODULE_UPDATE_DIR = "/data/adb/modules_update/";
+// Replaced/removed module trees are renamed here and deleted in the background
+constexpr const char* MODULE_TRASH_DIR = "/data/adb/.modules_trash/";
+// Trash batches handed to a running purge; locked while `rm` works on them
+constexpr const char* MODULE_PURGE_DIR = "/data/adb/.modules_purge/";
+// Serializes renames into and out of MODULE_TRASH_DIR across processes
+constexpr const char* MODULE_TRASH_LOCK_PATH = "/data/adb/.modules_trash.lock";
 constexpr const char* METAMODULE_DIR = "/data/adb/metamodule/";
+// Cached scan of MODULE_DIR, see module_index.hpp
+constexpr const char* MODULE_INDEX_PATH = "/data/adb/ksu/.module_index";
+// Subtrees of /data/adb already relabeled by the boot restorecon walk
+constexpr const char* RESTORECON_STAMP_PATH = "/data/adb/ksu/.restorecon_stamp";
 
 constexpr const char* MODULE_WEB_DIR = "webroot";
 constexpr const char* MODULE_ACTION_SH = "action.sh";
@@ -71,6 +87,11 @@ constexpr const char* KSU_BACKUP_DIR = "/data/adb/ksu/";
 constexpr const char* KSU_BACKUP_FILE_PREFIX = "ksu_backup_";
 constexpr const char* BACKUP_FILENAME = "stock_image.sha1";
 constexpr const char* UMOUNT_CONFIG_PATH = "/data/adb/ksu/.umount";
+// Present: blocking-stage scripts run in parallel; optional content is the concurrency limit,
+// empty or 0 means the number of online CPUs
+constexpr const char* PARALLEL_SCRIPTS_PATH = "/data/adb/ksu/.parallel_scripts";
+// Time limits for blocking-stage scripts, see script_limits.hpp
+constexpr const char* SCRIPT_LIMITS_PATH = "/data/adb/ksu/.script_limits";
 
 // Feature IDs - must match kernel definitions
 enum class FeatureId : uint32_t {
@@ -24,24 +24,18 @@ static constexpr const char* AK3_WORK_DIR = "/data/adb/ksu/tmp/ak3_flash";
  * Check if device is A/B partitioned
  */
 static bool is_ab_device() {
-    auto result = exec_command({"getprop", "ro.build.ab_update"});
-    if (result.exit_code != 0)
-        return false;
-
-    std::string value = trim(result.stdout_str);
+    std::string value = trim(prop_snapshot().get_or("ro.build.ab_update"));
     if (value != "true")
         return false;
 
-    result = exec_command({"getprop", "ro.boot.slot_suffix"});
-    return !trim(result.stdout_str).empty();
+    return !trim(prop_snapshot().get_or("ro.boot.slot_suffix")).empty();
 }
 
 /**
  * Get current slot suffix
  */
 static std::string get_current_slot() {
-    auto result = exec_command({"getprop", "ro.boot.slot_suffix"});
-    return trim(result.stdout_str);
+    return trim(prop_snapshot().get_or("ro.boot.slot_suffix"));
 }
 
 /**
@@ -53,6 +47,7 @@ static bool set_slot_suffix(const std::string& slot) {
         suffix = "_" + slot;
     }
     auto result = exec_command({"resetprop", "-n", "ro.boot.slot_suffix", suffix});
+    prop_snapshot().refresh();
     return result.exit_code == 0;
 }
 
@@ -79,13 +79,11 @@ static std::string exec_cmd(const std::string& cmd) {
 }
 
 std::string get_current_slot_suffix() {
-    auto result = exec_command_sync({"getprop", "ro.boot.slot_suffix"});
-    return trim(result.stdout_str);
+    return trim(prop_snapshot().get_or("ro.boot.slot_suffix"));
 }
 
 bool is_ab_device() {
-    auto result = exec_command_sync({"getprop", "ro.build.ab_update"});
-    if (trim(result.stdout_str) != "true") {
+    if (trim(prop_snapshot().get_or("ro.build.ab_update")) != "true") {
         return false;
     }
     return !get_current_slot_suffix().empty();
@@ -650,7 +648,7 @@ std::string get_kernel_version(const std::string& slot_suffix) {
     std::string magiskboot = find_magiskboot("", workdir);
     if (magiskboot.empty()) {
         LOGE("magiskboot not found");
-        exec_command_sync({"rm", "-rf", workdir});
+        remove_tree(workdir);
         return "";
     }
 
@@ -723,7 +721,7 @@ std::string get_kernel_version(const std::string& slot_suffix) {
     }
 
     // Cleanup
-    exec_command_sync({"rm", "-rf", workdir});
+    remove_tree(workdir);
 
     if (result.empty()) {
         LOGE("Failed to get kernel version");
@@ -740,11 +738,6 @@ std::string get_boot_slot_info() {
     std::string current_slot = get_current_slot_suffix();
     std::string other_slot = (current_slot == "_a") ? "_b" : "_a";
 
-    // Get slot info from properties
-    auto result_a = exec_command_sync({"getprop", "ro.boot.slot_suffix"});
-    auto unbootable = exec_command_sync({"getprop", "ro.boot.slot.unbootable"});
-    auto successful = exec_command_sync({"getprop", "ro.boot.slot.successful"});
-
     std::string json = "{";
     json += "\"is_ab\":true,";
     json += "\"current_slot\":\"" + current_slot + "\",";
@@ -1,10 +1,12 @@
 #include "init_event.hpp"
 #include "assets.hpp"
 #include "core/allowlist.hpp"
+#include "core/boot_trace.hpp"
 #include "binder/murasaki_binder.hpp"
 #include "binder/shizuku_service.hpp"
 #include "core/hide_bootloader.hpp"
 #include "core/restorecon.hpp"
+#include "core/task_graph.hpp"
 #include "defs.hpp"
 #include "log.hpp"
 #include "murasaki_dispatch.hpp"
@@ -24,28 +26,32 @@
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstring>
 
 namespace ksud {
 
-// Load Murasaki Binder service SEPolicy rules
-static void load_murasaki_sepolicy() {
+// Patch SEPolicy with module rules, the Murasaki Binder service rules and app profile
+// sepolicies, in that order, as one compiled set
+static void load_boot_sepolicy() {
+    std::vector<SepolicySource> sources;
+    collect_sepolicy_rules(sources);
+
     const uint8_t* data = nullptr;
     size_t size = 0;
-
-    if (!get_asset("murasaki_sepolicy.rule", data, size)) {
+    if (get_asset("murasaki_sepolicy.rule", data, size)) {
+        sources.push_back({"murasaki", std::string(reinterpret_cast<const char*>(data), size)});
+    } else {
         LOGW("Failed to get murasaki_sepolicy.rule asset");
-        return;
     }
 
-    std::string rules(reinterpret_cast<const char*>(data), size);
-    LOGI("Loading Murasaki SEPolicy rules...");
+    collect_profile_sepolies(sources);
 
-    int ret = sepolicy_live_patch(rules);
+    int ret = sepolicy_apply_compiled("post-fs-data", sources);
     if (ret != 0) {
-        LOGW("Failed to apply Murasaki sepolicy rules: %d", ret);
+        LOGW("Failed to apply some sepolicy rules: %d", ret);
     } else {
-        LOGI("Murasaki SEPolicy rules applied successfully");
+        LOGI("SEPolicy rules applied successfully");
     }
 }
 
@@ -70,6 +76,7 @@ static void catch_bootlog(const char* logname, const std::vector<const char*>& c
 
     if (pid == 0) {
         // Child process
+        boot_trace_detach();
         // Create new process group
         setpgid(0, 0);
 
@@ -103,7 +110,15 @@ static void catch_bootlog(const char* logname, const std::vector<const char*>& c
     LOGI("Started %s capture (pid %d)", logname, pid);
 }
 
+// Run one boot step inside a trace span named after it
+template <typename Fn>
+static void trace_step(const char* name, Fn&& fn) {
+    TraceSpan span(name);
+    fn();
+}
+
 static void run_stage(const std::string& stage, bool block) {
+    TraceSpan span("run_stage " + stage);
     umask(0);
 
     // Check for Magisk (like Rust version)
@@ -118,17 +133,21 @@ static void run_stage(const std::string& stage, bool block) {
     }
 
     // Execute common scripts first
-    exec_common_scripts(stage + ".d", block);
+    trace_step("exec_common_scripts", [&] { exec_common_scripts(stage + ".d", block); });
 
     // Execute metamodule stage script (priority)
-    metamodule_exec_stage_script(stage, block);
+    trace_step("metamodule_exec_stage_script",
+               [&] { metamodule_exec_stage_script(stage, block); });
 
     // Execute regular modules stage scripts
-    exec_stage_script(stage, block);
+    trace_step("exec_stage_script", [&] { exec_stage_script(stage, block); });
 }
 
 int on_post_data_fs() {
     LOGI("post-fs-data triggered");
+    // First stage of the boot: start a new trace file
+    BootTraceSession trace_session("post-fs-data", true);
+    TraceSpan stage_span("post-fs-data");
 
     // Report to kernel first
     report_post_fs_data();
@@ -136,7 +155,7 @@ int on_post_data_fs() {
     umask(0);
 
     // Clear all temporary module configs early (like Rust version)
-    clear_all_temp_configs();
+    trace_step("clear_all_temp_configs", clear_all_temp_configs);
 
     // Catch boot logs
     catch_bootlog("logcat", {"logcat", "-b", "all"});
@@ -155,7 +174,7 @@ int on_post_data_fs() {
         LOGW("safe mode, skip common post-fs-data.d scripts");
     } else {
         // Execute common post-fs-data scripts
-        exec_common_scripts("post-fs-data.d", true);
+        trace_step("exec_common_scripts", [] { exec_common_scripts("post-fs-data.d", true); });
     }
 
     // Ensure directories exist
@@ -168,52 +187,59 @@ int on_post_data_fs() {
     auto root_impl = read_file(ROOT_IMPL_CONFIG_PATH);
     std::string impl = root_impl ? trim(*root_impl) : "";
     const char* active_bin_dir = (impl == "apatch") ? AP_BIN_DIR : KSU_BIN_DIR;
-    if (ensure_binaries(active_bin_dir, true) != 0) {
-        LOGW("Failed to ensure binaries");
-    }
+    auto ensure_bins = [active_bin_dir] {
+        if (ensure_binaries(active_bin_dir, true) != 0) {
+            LOGW("Failed to ensure binaries");
+        }
+    };
 
     // if we are in safe mode, we should disable all modules
     if (safe_mode) {
+        trace_step("ensure_binaries", ensure_bins);
         LOGW("safe mode, skip post-fs-data scripts and disable all modules!");
-        disable_all_modules();
+        trace_step("disable_all_modules", disable_all_modules);
         return 0;
     }
 
-    // Handle updated modules
-    handle_updated_modules();
-
-    // Prune modules marked for removal
-    prune_modules();
-
-    // Restorecon
-    restorecon("/data/adb", true);
-
-    // Load sepolicy rules from modules
-    load_sepolicy_rule();
-
-    // Load Murasaki Binder service sepolicy rules
-    load_murasaki_sepolicy();
-
-    // Apply profile sepolicies
-    apply_profile_sepolies();
-
-    // Load feature config (with init_features handling managed features)
-    init_features();
-
-    // Execute metamodule post-fs-data script first (priority)
-    metamodule_exec_stage_script("post-fs-data", true);
-
-    // Execute module post-fs-data scripts
-    exec_stage_script("post-fs-data", true);
-
-    // Load system.prop from modules
-    load_system_prop();
-
-    // Execute metamodule mount script
-    metamodule_exec_mount_script();
-
-    // Load umount config and apply to kernel
-    umount_apply_config();
+    // The rest of the stage as a dependency graph. Setup steps that do not touch each other
+    // run concurrently; everything a module script can observe is finished before the first
+    // script starts, and the script phase keeps its original order.
+    TaskGraph graph;
+    auto bins = graph.add("ensure_binaries", ensure_bins);
+    // Updated modules are swapped in before modules marked for removal are pruned
+    auto updated = graph.add("handle_updated_modules", [] { handle_updated_modules(); });
+    auto pruned = graph.add("prune_modules", [] { prune_modules(); }, {updated});
+    // Relabels the freshly swapped-in module trees and extracted binaries; subtrees unchanged
+    // since the last boot are skipped, and so is the trash the purge is deleting meanwhile
+    auto relabeled = graph.add(
+        "restorecon",
+        [] {
+            auto below_adb = [](const char* dir) {
+                std::string rel = std::string(dir).substr(strlen(ADB_DIR));
+                return rel.substr(0, rel.find('/'));
+            };
+            restore_syscon_if_unlabeled("/data/adb", RESTORECON_STAMP_PATH, nullptr,
+                                        {below_adb(MODULE_TRASH_DIR), below_adb(MODULE_PURGE_DIR)});
+        },
+        {bins, pruned});
+    auto policy = graph.add("load_boot_sepolicy", load_boot_sepolicy, {pruned});
+    // Managed features are declared by the surviving modules
+    auto features = graph.add("init_features", [] { init_features(); }, {pruned});
+    auto umount = graph.add("umount_apply_config", [] { umount_apply_config(); });
+
+    // Execute metamodule post-fs-data script first (priority), then module scripts
+    auto meta_script = graph.add(
+        "metamodule_exec_stage_script",
+        [] { metamodule_exec_stage_script("post-fs-data", true); },
+        {bins, relabeled, policy, features, umount});
+    auto scripts = graph.add(
+        "exec_stage_script", [] { exec_stage_script("post-fs-data", true); }, {meta_script});
+    // system.prop is applied after module scripts had their chance to change it
+    auto props = graph.add("load_system_prop", [] { load_system_prop(); }, {scripts});
+    graph.add("metamodule_exec_mount_script", [] { metamodule_exec_mount_script(); }, {props});
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    graph.run(static_cast<unsigned>(std::clamp<long>(cpus, 1, 4)));
 
     // Run post-mount stage
     run_stage("post-mount", true);
@@ -226,9 +252,11 @@ int on_post_data_fs() {
 
 void on_services() {
     LOGI("services triggered");
+    BootTraceSession trace_session("service", false);
+    TraceSpan stage_span("service");
 
     // Hide bootloader unlock status (soft BL hiding)
-    hide_bootloader_status();
+    trace_step("hide_bootloader_status", hide_bootloader_status);
 
     // Long-lived child: register Murasaki service, write allowlist to Rei dir for Zygisk bridge
     pid_t pid = fork();
@@ -239,6 +267,7 @@ void on_services() {
     }
     if (pid == 0) {
         // Child: become Murasaki/Shizuku service process, run in background
+        boot_trace_detach();
         (void)ensure_dir_exists(REI_DIR);
         auto root_impl_opt = read_file(ROOT_IMPL_CONFIG_PATH);
         std::string root_impl = root_impl_opt ? trim(*root_impl_opt) : "ksu";
@@ -254,6 +283,8 @@ void on_services() {
 
 void on_boot_completed() {
     LOGI("boot-completed triggered");
+    BootTraceSession trace_session("boot-completed", false);
+    TraceSpan stage_span("boot-completed");
 
     // Report to kernel
     report_boot_complete();
@@ -263,6 +294,7 @@ void on_boot_completed() {
 
     // murasaki_dispatch: scan MRSK/Shizuku apps (Sui style), try BinderDispatcher, elevate first success as manager; shared by ksud/ap
     LOGI("Dispatching Shizuku Binder to apps...");
+    TraceSpan dispatch_span("dispatch_shizuku_binder");
     std::vector<AllowlistEntry> entries = allowlist_read_unified();
     std::optional<std::string> owner =
         dispatch_shizuku_binder_and_get_owner(entries, get_manager_uid());
@@ -315,7 +347,7 @@ int run_daemon() {
         "allow untrusted_app_all su binder { call transfer };"
         "allow untrusted_app_all default_android_service service_manager find;";
 
-    int sepolicy_ret = sepolicy_live_patch(rules);
+    int sepolicy_ret = sepolicy_apply_compiled("daemon", {{"binder", rules}});
     if (sepolicy_ret != 0) {
         LOGE("Failed to patch SEPolicy: %d", sepolicy_ret);
     } else {
@@ -408,10 +408,7 @@ int boot_patch(const std::vector<std::string>& args) {
     }
 
     // Cleanup function
-    auto cleanup = [&workdir]() {
-        std::string cmd = "rm -rf " + workdir;
-        system(cmd.c_str());
-    };
+    auto cleanup = [&workdir]() { remove_tree(workdir); };
 
     // Find magiskboot
     std::string magiskboot = find_magiskboot(parsed.magiskboot, workdir);
@@ -774,10 +771,7 @@ int boot_restore(const std::vector<std::string>& args) {
     }
     std::string workdir = tmpdir;
 
-    auto cleanup = [&workdir]() {
-        std::string cmd = "rm -rf " + workdir;
-        system(cmd.c_str());
-    };
+    auto cleanup = [&workdir]() { remove_tree(workdir); };
 
     // Find magiskboot
     std::string magiskboot = find_magiskboot(parsed.magiskboot, workdir);
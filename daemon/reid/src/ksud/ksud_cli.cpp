@@ -1,5 +1,6 @@
 #include "cli.hpp"
 #include "assets.hpp"
+#include "core/boot_trace.hpp"
 #include "core/hide_bootloader.hpp"
 #include "defs.hpp"
 #include "flash/flash_ak3.hpp"
@@ -20,9 +21,12 @@
 
 #include <unistd.h>
 #include <algorithm>
+#include <cerrno>
+#include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <iostream>
+#include <sstream>
 #include <vector>
 
 namespace ksud {
@@ -53,11 +57,50 @@ static void print_ksud_usage() {
 }
 
 // Module subcommand handlers
+// Batch install manifest: one zip path per line, '#' starts a comment line.
+// Relative paths are resolved against the manifest's directory.
+static bool read_install_manifest(const std::string& manifest, std::vector<std::string>& out) {
+    auto content = read_file(manifest);
+    if (!content) {
+        printf("! Failed to read manifest: %s\n", manifest.c_str());
+        return false;
+    }
+    std::string base;
+    auto slash = manifest.rfind('/');
+    if (slash != std::string::npos)
+        base = manifest.substr(0, slash + 1);
+
+    std::istringstream iss(*content);
+    std::string line;
+    while (std::getline(iss, line)) {
+        line = trim(line);
+        if (line.empty() || line[0] == '#')
+            continue;
+        out.push_back(line[0] == '/' ? line : base + line);
+    }
+    return true;
+}
+
+// Decimal option value in [0, max]; rejects empty values, signs and trailing characters
+static bool parse_count_arg(const std::string& value, long max, long* out) {
+    if (value.empty() || value[0] < '0' || value[0] > '9')
+        return false;
+    char* end = nullptr;
+    errno = 0;
+    long n = std::strtol(value.c_str(), &end, 10);
+    if (errno != 0 || *end != '\0' || n > max)
+        return false;
+    *out = n;
+    return true;
+}
+
 static int cmd_module(const std::vector<std::string>& args) {
     if (args.empty()) {
         printf("USAGE: ksud module <SUBCOMMAND>\n\n");
         printf("SUBCOMMANDS:\n");
-        printf("  install <ZIP>     Install module\n");
+        printf("  install <ZIP>...  Install modules (--jobs N: extraction threads,\n");
+        printf("                    --manifest FILE: one zip path per line,\n");
+        printf("                    - / --fd N: read the zip from stdin / an open fd)\n");
         printf("  uninstall <ID>    Uninstall module\n");
         printf("  enable <ID>       Enable module\n");
         printf("  disable <ID>      Disable module\n");
@@ -76,7 +119,45 @@ static int cmd_module(const std::vector<std::string>& args) {
     const std::string& subcmd = args[0];
 
     if (subcmd == "install" && args.size() > 1) {
-        return module_install(args[1]);
+        auto usage = []() {
+            printf("USAGE: ksud module install [--jobs N] [--manifest FILE] [--fd N] <ZIP|->...\n");
+            return 1;
+        };
+        unsigned jobs = 0;
+        std::vector<std::string> zip_paths;
+        for (size_t i = 1; i < args.size(); i++) {
+            const std::string& arg = args[i];
+            bool takes_value =
+                arg == "--jobs" || arg == "-j" || arg == "--fd" || arg == "--manifest";
+            if (takes_value && i + 1 == args.size()) {
+                printf("! Missing value for %s\n", arg.c_str());
+                return usage();
+            }
+            if (arg == "--jobs" || arg == "-j" || starts_with(arg, "--jobs=")) {
+                std::string value = starts_with(arg, "--jobs=") ? arg.substr(7) : args[++i];
+                long n;
+                if (!parse_count_arg(value, INT_MAX, &n)) {
+                    printf("! Invalid --jobs value: %s\n", value.c_str());
+                    return usage();
+                }
+                jobs = static_cast<unsigned>(n);
+            } else if (arg == "--fd") {
+                long fd;
+                if (!parse_count_arg(args[++i], INT_MAX, &fd)) {
+                    printf("! Invalid --fd value: %s\n", args[i].c_str());
+                    return usage();
+                }
+                zip_paths.push_back("/proc/self/fd/" + std::to_string(fd));
+            } else if (arg == "--manifest") {
+                if (!read_install_manifest(args[++i], zip_paths))
+                    return 1;
+            } else {
+                zip_paths.push_back(arg);
+            }
+        }
+        if (zip_paths.empty())
+            return usage();
+        return module_install(zip_paths, jobs);
     } else if (subcmd == "uninstall" && args.size() > 1) {
         return module_uninstall(args[1]);
     } else if (subcmd == "undo-uninstall" && args.size() > 1) {
@@ -175,6 +256,7 @@ static int cmd_debug(const std::vector<std::string>& args) {
         printf("  getenforce         Get SELinux mode\n");
         printf("  ksu-info           Get KernelSU info (JSON)\n");
         printf("  mark <get|mark|unmark|refresh> [PID]\n");
+        printf("  boot-trace         Summarize the last boot timeline by self time\n");
         return 1;
     }
 
@@ -185,6 +267,8 @@ static int cmd_debug(const std::vector<std::string>& args) {
         return debug_set_manager(pkg);
     } else if (subcmd == "get-sign" && args.size() > 1) {
         return debug_get_sign(args[1]);
+    } else if (subcmd == "boot-trace") {
+        return boot_trace_summary();
     } else if (subcmd == "version") {
         printf("Kernel Version: %d\n", get_version());
         return 0;
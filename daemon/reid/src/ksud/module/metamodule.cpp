@@ -1,9 +1,13 @@
 #include "metamodule.hpp"
+#include "../../core/boot_trace.hpp"
 #include "../../defs.hpp"
 #include "../../log.hpp"
 #include "../../utils.hpp"
+#include "module_index.hpp"
+#include "script_limits.hpp"
 
 #include <dirent.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
 #include <sys/wait.h>
 #include <unistd.h>
@@ -16,7 +20,8 @@ static bool file_exists(const std::string& path) {
     return stat(path.c_str(), &st) == 0;
 }
 
-static int run_script(const std::string& script, bool block) {
+// Blocking stage scripts are subject to script_limits()
+static int run_script(const std::string& script, bool block, const std::string& stage) {
     if (!file_exists(script))
         return 0;
 
@@ -33,6 +38,7 @@ static int run_script(const std::string& script, bool block) {
     const char* busybox_path = busybox.c_str();
     const char* script_path = script.c_str();
 
+    int64_t start_ns = trace_now_ns();
     pid_t pid = fork();
     if (pid == 0) {
         setsid();
@@ -54,7 +60,12 @@ static int run_script(const std::string& script, bool block) {
 
     if (block) {
         int status;
-        waitpid(pid, &status, 0);
+        struct rusage usage;
+        if (!wait_script_until(pid, script_deadline_ns(stage, start_ns), &status, &usage)) {
+            expire_script(pid, script, start_ns);
+            return -1;
+        }
+        trace_child(script, pid, start_ns, &usage);
         return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
     }
 
@@ -68,7 +79,10 @@ int metamodule_init() {
 
 int metamodule_exec_stage_script(const std::string& stage, bool block) {
     std::string script = std::string(METAMODULE_DIR) + stage + ".sh";
-    return run_script(script, block);
+    int ret = run_script(script, block, stage);
+    // The metamodule script may have changed the modules the next stage step reads
+    module_index_invalidate();
+    return ret;
 }
 
 int metamodule_exec_mount_script() {
@@ -88,6 +102,7 @@ int metamodule_exec_mount_script() {
         const char* busybox_path = busybox.c_str();
         const char* script_path = script.c_str();
 
+        int64_t start_ns = trace_now_ns();
         pid_t pid = fork();
         if (pid == 0) {
             setsid();
@@ -109,7 +124,9 @@ int metamodule_exec_mount_script() {
         }
 
         int status;
-        waitpid(pid, &status, 0);
+        struct rusage usage;
+        wait4(pid, &status, 0, &usage);
+        trace_child(script, pid, start_ns, &usage);
         int ret = WIFEXITED(status) ? WEXITSTATUS(status) : -1;
 
         if (ret == 0) {
@@ -1,22 +1,41 @@
 #include "module.hpp"
 #include "../../assets.hpp"
+#include "../../core/boot_trace.hpp"
+#include "../../core/restorecon.hpp"
 #include "../ksucalls.hpp"
 #include "../../defs.hpp"
 #include "../../log.hpp"
 #include "../sepolicy/sepolicy.hpp"
 #include "../../utils.hpp"
+#include "module_index.hpp"
+#include "script_limits.hpp"
+#include "zip_archive.hpp"
 
 #include <dirent.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/file.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <linux/memfd.h>
+#include <sys/statvfs.h>
+#include <sys/syscall.h>
 #include <sys/sysmacros.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
 #include <climits>
 #include <cstdlib>
 #include <cstring>
 #include <fstream>
+#include <future>
 #include <map>
+#include <memory>
+#include <set>
 #include <sstream>
+#include <thread>
 #include <vector>
 
 namespace ksud {
@@ -119,25 +138,6 @@ static std::string resolve_module_icon_path(const std::string& icon_value,
     return icon_value;
 }
 
-static std::map<std::string, std::string> parse_module_prop(const std::string& path) {
-    std::map<std::string, std::string> props;
-    std::ifstream ifs(path);
-    if (!ifs)
-        return props;
-
-    std::string line;
-    while (std::getline(ifs, line)) {
-        size_t eq = line.find('=');
-        if (eq != std::string::npos) {
-            std::string key = trim(line.substr(0, eq));
-            std::string value = trim(line.substr(eq + 1));
-            props[key] = value;
-        }
-    }
-
-    return props;
-}
-
 // Validate module ID - must be alphanumeric with underscores/hyphens, no path separators
 static bool validate_module_id(const std::string& id) {
     if (id.empty())
@@ -161,45 +161,107 @@ static bool validate_module_id(const std::string& id) {
 }
 
 // Forward declaration
-static int run_script(const std::string& script, bool block, const std::string& module_id = "");
+// stage: blocking boot stage the script belongs to, which subjects it to script_limits()
+static int run_script(const std::string& script, bool block, const std::string& module_id = "",
+                      const std::string& stage = "");
+
+// Ownership, mode and SELinux context for everything below `base` (relative to the module
+// root, "" for the root itself). The rule with the deepest matching base wins.
+struct PermRule {
+    std::string base;
+    uid_t uid;
+    gid_t gid;
+    mode_t dir_mode;
+    mode_t file_mode;
+    const char* secontext;
+};
 
-// Extract zip file to directory using unzip command
-static bool extract_zip(const std::string& zip_path, const std::string& dest_dir) {
-    auto result = exec_command({"unzip", "-o", "-q", zip_path, "-d", dest_dir});
-    return result.exit_code == 0;
+// Default permissions, bin/xbin directories and vendor with its own secontext
+static const std::vector<PermRule>& module_perm_rules() {
+    static const std::vector<PermRule> rules = {
+        {"", 0, 0, 0755, 0644, SYSTEM_CON},
+        {"system/bin", 0, 2000, 0755, 0755, SYSTEM_CON},
+        {"system/xbin", 0, 2000, 0755, 0755, SYSTEM_CON},
+        {"system/system_ext/bin", 0, 2000, 0755, 0755, SYSTEM_CON},
+        {"system/vendor", 0, 2000, 0755, 0755, "u:object_r:vendor_file:s0"},
+    };
+    return rules;
 }
 
-// Set permissions recursively
-static void set_perm_recursive(const std::string& path, uid_t uid, gid_t gid, mode_t dir_mode,
-                               mode_t file_mode,
-                               const char* secontext = "u:object_r:system_file:s0") {
-    DIR* dir = opendir(path.c_str());
-    if (!dir)
-        return;
+// Rule apply_perm_dir() uses for the file at `rel`: the one with the deepest enclosing base
+static const PermRule& perm_rule_for(const std::vector<PermRule>& rules, const std::string& rel) {
+    const PermRule* best = &rules.front();
+    for (const auto& r : rules) {
+        if (!r.base.empty() && r.base.size() > best->base.size() &&
+            starts_with(rel, r.base + "/"))
+            best = &r;
+    }
+    return *best;
+}
+
+struct PermStats {
+    size_t entries = 0;
+    size_t failed = 0;
+};
+
+// Walk a directory through its fd and apply `rule` (or a more specific one) to each child
+static void apply_perm_dir(DIR* dir, const std::string& rel, const PermRule* rule,
+                           const std::vector<PermRule>& rules, PermStats& stats) {
+    for (const auto& r : rules) {
+        if (r.base == rel) {
+            rule = &r;
+            break;
+        }
+    }
 
+    int dfd = dirfd(dir);
     struct dirent* entry;
     while ((entry = readdir(dir)) != nullptr) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0)
             continue;
 
-        std::string fullpath = path + "/" + entry->d_name;
         struct stat st;
-        if (lstat(fullpath.c_str(), &st) != 0)
+        if (fstatat(dfd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
             continue;
 
-        if (S_ISDIR(st.st_mode)) {
-            chown(fullpath.c_str(), uid, gid);
-            chmod(fullpath.c_str(), dir_mode);
-            // Set SELinux context using chcon command
-            exec_command({"chcon", secontext, fullpath});
-            set_perm_recursive(fullpath, uid, gid, dir_mode, file_mode, secontext);
-        } else {
-            chown(fullpath.c_str(), uid, gid);
-            chmod(fullpath.c_str(), file_mode);
-            exec_command({"chcon", secontext, fullpath});
+        bool is_dir = S_ISDIR(st.st_mode);
+        bool ok = fchownat(dfd, name, rule->uid, rule->gid, AT_SYMLINK_NOFOLLOW) == 0;
+        if (!S_ISLNK(st.st_mode)) {
+            ok &= fchmodat(dfd, name, is_dir ? rule->dir_mode : rule->file_mode, 0) == 0;
+        }
+        ok &= lsetfilecon_at(dfd, name, rule->secontext);
+        stats.entries++;
+        if (!ok)
+            stats.failed++;
+
+        if (is_dir) {
+            int child_fd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+            if (child_fd < 0)
+                continue;
+            DIR* child = fdopendir(child_fd);
+            if (!child) {
+                close(child_fd);
+                continue;
+            }
+            apply_perm_dir(child, rel.empty() ? name : rel + "/" + name, rule, rules, stats);
+            closedir(child);
         }
     }
+}
+
+// Apply all permission rules to a module tree in a single pass
+static PermStats set_perm_rules(const std::string& root, const std::vector<PermRule>& rules) {
+    PermStats stats;
+    if (rules.empty())
+        return stats;
+
+    DIR* dir = opendir(root.c_str());
+    if (!dir)
+        return stats;
+    apply_perm_dir(dir, "", &rules.front(), rules, stats);
     closedir(dir);
+    return stats;
 }
 
 // Handle partition symlinks (vendor, system_ext, product, odm)
@@ -217,8 +279,11 @@ static void handle_partition(const std::string& modpath, const std::string& part
         printf("- Handle partition /%s\n", partition.c_str());
 
         std::string new_path = modpath + "/" + partition;
-        std::string cmd = "mv -f " + part_path + " " + new_path;
-        system(cmd.c_str());
+        if (rename(part_path.c_str(), new_path.c_str()) != 0) {
+            LOGW("Failed to move %s to %s: %s", part_path.c_str(), new_path.c_str(),
+                 strerror(errno));
+            return;
+        }
 
         std::string link_path = modpath + "/system/" + partition;
         symlink(("../" + partition).c_str(), link_path.c_str());
@@ -228,10 +293,93 @@ static void handle_partition(const std::string& modpath, const std::string& part
 // Mark file for removal (create character device node)
 static void mark_remove(const std::string& path) {
     std::string dir = path.substr(0, path.find_last_of('/'));
-    exec_command({"mkdir", "-p", dir});
+    mkdirs(dir);
     mknod(path.c_str(), S_IFCHR | 0644, makedev(0, 0));
 }
 
+// flock on MODULE_TRASH_LOCK_PATH, held only around renames; -1 if it cannot be taken
+static int lock_module_trash() {
+    int fd = open(MODULE_TRASH_LOCK_PATH, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (fd >= 0 && flock(fd, LOCK_EX) != 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+// Move a module tree into the trash with one rename; purge_module_trash() deletes it later
+static bool discard_module_tree(const std::string& path) {
+    static unsigned seq = 0;
+    std::string name = path.substr(path.find_last_of('/') + 1);
+    std::string trash = std::string(MODULE_TRASH_DIR) + name + "." + std::to_string(getpid()) +
+                        "." + std::to_string(seq++);
+    int lock = lock_module_trash();
+    mkdirs(MODULE_TRASH_DIR);
+    bool moved = rename(path.c_str(), trash.c_str()) == 0;
+    int err = errno;
+    if (lock >= 0)
+        close(lock);
+    if (moved)
+        return true;
+    LOGW("Failed to move %s to trash: %s", path.c_str(), strerror(err));
+    return remove_tree(path);
+}
+
+// Delete everything in the trash off the critical path. The trash directory is renamed into
+// MODULE_PURGE_DIR as one batch, so discard_module_tree() never waits for the deletion, and a
+// detached `rm` removes the batches while holding a lock on MODULE_PURGE_DIR. If another purge
+// still holds it, the new batch is left for the next purge.
+static void purge_module_trash() {
+    static unsigned seq = 0;
+    int lock = lock_module_trash();
+    if (file_exists(MODULE_TRASH_DIR)) {
+        mkdirs(MODULE_PURGE_DIR);
+        std::string batch = std::string(MODULE_PURGE_DIR) + std::to_string(getpid()) + "." +
+                            std::to_string(seq++);
+        if (rename(MODULE_TRASH_DIR, batch.c_str()) != 0)
+            LOGW("Failed to move %s to %s: %s", MODULE_TRASH_DIR, batch.c_str(), strerror(errno));
+    }
+    if (lock >= 0)
+        close(lock);
+
+    int purge_fd = open(MODULE_PURGE_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (purge_fd < 0)
+        return;
+    if (flock(purge_fd, LOCK_EX | LOCK_NB) != 0) {
+        close(purge_fd);
+        return;
+    }
+    std::vector<std::string> batches;
+    if (DIR* dir = opendir(MODULE_PURGE_DIR)) {
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != nullptr) {
+            if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0)
+                batches.push_back(std::string(MODULE_PURGE_DIR) + entry->d_name);
+        }
+        closedir(dir);
+    }
+    remove_tree_async(batches, purge_fd);
+    close(purge_fd);
+}
+
+// Put the fully built `staged` tree at `target` in a single rename, so `target` is never seen
+// half-written. Whatever was at `target` before ends up in the trash.
+static bool swap_in_module_tree(const std::string& staged, const std::string& target) {
+    if (!file_exists(target))
+        return rename(staged.c_str(), target.c_str()) == 0;
+
+    if (exchange_paths(staged, target)) {
+        // `staged` now holds the previous tree
+        discard_module_tree(staged);
+        return true;
+    }
+
+    // No RENAME_EXCHANGE (old kernel or filesystem): two renames, still no copying
+    if (!discard_module_tree(target))
+        return false;
+    return rename(staged.c_str(), target.c_str()) == 0;
+}
+
 // Check if module is metamodule
 static bool is_metamodule(const std::map<std::string, std::string>& props) {
     auto it = props.find("metamodule");
@@ -301,7 +449,7 @@ static bool create_metamodule_symlink(const std::string& module_id) {
         if (S_ISLNK(st.st_mode)) {
             unlink(link_path.c_str());
         } else if (S_ISDIR(st.st_mode)) {
-            exec_command({"rm", "-rf", link_path});
+            remove_tree(link_path);
         }
     }
 
@@ -457,43 +605,220 @@ export API ARCH ABI ABI32 IS64BIT
     return WIFEXITED(status) && WEXITSTATUS(status) == 0;
 }
 
-// Native C++ module installation - replaces shell script
-static bool exec_install_script(const std::string& zip_path) {
-    printf("- Extracting module files\n");
+static constexpr const char* FD_PATH_PREFIX = "/proc/self/fd/";
+
+// Make an archive handed over as a descriptor readable by path. A seekable regular file is used
+// in place; a pipe is drained once into a sealed memfd. The returned fd is left inheritable so
+// customize.sh can read ZIPFILE, and stays open until the install run ends.
+static int receive_module_fd(int src_fd) {
+    struct stat st;
+    if (fstat(src_fd, &st) != 0) {
+        printf("! Invalid module fd %d: %s\n", src_fd, strerror(errno));
+        return -1;
+    }
+    if (S_ISREG(st.st_mode) && lseek(src_fd, 0, SEEK_CUR) >= 0) {
+        return dup(src_fd);
+    }
+
+    int memfd = static_cast<int>(
+        syscall(__NR_memfd_create, "module.zip", static_cast<unsigned>(MFD_ALLOW_SEALING)));
+    if (memfd < 0) {
+        printf("! memfd_create failed: %s\n", strerror(errno));
+        return -1;
+    }
 
-    // Get absolute path
+    uint64_t total = 0;
+    bool ok = true;
+    // splice moves pipe pages without a userspace copy; fall back to read/write otherwise
+    bool use_splice = true;
+    std::vector<char> buf;
+    while (true) {
+        ssize_t n;
+        if (use_splice) {
+            n = splice(src_fd, nullptr, memfd, nullptr, 1 << 20, SPLICE_F_MOVE);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS)) {
+                use_splice = false;
+                continue;
+            }
+        } else {
+            if (buf.empty())
+                buf.resize(1 << 16);
+            n = read(src_fd, buf.data(), buf.size());
+            for (ssize_t off = 0; n > 0 && off < n;) {
+                ssize_t w = write(memfd, buf.data() + off, static_cast<size_t>(n - off));
+                if (w < 0 && errno != EINTR) {
+                    n = -1;
+                    break;
+                }
+                off += w > 0 ? w : 0;
+            }
+        }
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n < 0) {
+            printf("! Failed to receive module archive: %s\n", strerror(errno));
+            ok = false;
+            break;
+        }
+        if (n == 0)
+            break;
+        total += static_cast<uint64_t>(n);
+    }
+
+    if (ok && total == 0) {
+        printf("! Received empty module archive\n");
+        ok = false;
+    }
+    if (!ok) {
+        close(memfd);
+        return -1;
+    }
+    fcntl(memfd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_WRITE | F_SEAL_SEAL);
+    LOGI("Received module archive into memfd (%llu bytes)", static_cast<unsigned long long>(total));
+    return memfd;
+}
+
+// Archives of a batch checked at once before anything is installed
+static constexpr size_t MODULE_CHECK_THREADS = 4;
+
+// Archive opened and validated ahead of its installation
+struct PreparedModule {
+    std::string zip_path;  // as given on the command line
+    std::string zipfile;   // resolved absolute path, exported as ZIPFILE
+    ZipArchive zip;
+    std::map<std::string, std::string> props;
+    std::string id;
+    std::string error;  // set when the archive cannot be installed
+};
+
+// Metamodule state, sampled once per install run
+struct InstallContext {
+    int safety;
+    std::string metamodule_id;
+};
+
+// Open the archive, index its central directory and parse module.prop. Prints nothing, so it
+// can run on a helper thread while the previous module is being extracted.
+static std::unique_ptr<PreparedModule> prepare_module(const std::string& zip_path) {
+    auto mod = std::make_unique<PreparedModule>();
+    mod->zip_path = zip_path;
+
+    // Get absolute path; received descriptors are already stable /proc/self/fd paths
     char realpath_buf[PATH_MAX];
-    if (!realpath(zip_path.c_str(), realpath_buf)) {
-        printf("! Invalid zip path: %s\n", zip_path.c_str());
-        return false;
+    if (starts_with(zip_path, FD_PATH_PREFIX)) {
+        mod->zipfile = zip_path;
+    } else if (realpath(zip_path.c_str(), realpath_buf)) {
+        mod->zipfile = realpath_buf;
+    } else {
+        mod->error = "Invalid zip path: " + zip_path;
+        return mod;
     }
-    std::string zipfile = realpath_buf;
 
-    // Create temp directory
-    std::string tmpdir = "/dev/tmp";
-    exec_command({"rm", "-rf", tmpdir});
-    exec_command({"mkdir", "-p", tmpdir});
-    exec_command({"chcon", "u:object_r:system_file:s0", tmpdir});
+    // Open the archive once; every later lookup uses the in-memory central directory
+    if (!mod->zip.open(mod->zipfile)) {
+        mod->error = "Unable to open zip file";
+        return mod;
+    }
 
-    // Extract module.prop first
-    auto result = exec_command({"unzip", "-o", "-q", zipfile, "module.prop", "-d", tmpdir});
-    if (result.exit_code != 0) {
-        printf("! Unable to extract zip file\n");
-        exec_command({"rm", "-rf", tmpdir});
-        return false;
+    // Read module.prop straight into memory
+    auto prop_content = mod->zip.read("module.prop");
+    if (!prop_content) {
+        mod->error = "Unable to extract zip file";
+        return mod;
     }
 
-    // Parse module.prop
-    auto props = parse_module_prop(tmpdir + "/module.prop");
-    std::string mod_id = props.count("id") ? props["id"] : "";
-    std::string mod_name = props.count("name") ? props["name"] : "";
-    std::string mod_author = props.count("author") ? props["author"] : "";
+    mod->props = parse_module_prop_content(*prop_content);
+    mod->id = mod->props.count("id") ? mod->props["id"] : "";
+    if (mod->id.empty()) {
+        mod->error = "Module ID not found in module.prop";
+    } else if (!validate_module_id(mod->id)) {
+        mod->error = "Invalid module ID: " + mod->id;
+    }
+    return mod;
+}
+
+// Space an extraction with `opts` writes: the selected regular members, except files that
+// will be hard-linked from the installed version (same size and can_share_inode agrees)
+static ZipSizeInfo extract_size_info(const ZipArchive& zip, const ZipExtractOptions& opts) {
+    auto matches = [](const std::vector<std::string>& globs, const std::string& name) {
+        return std::any_of(globs.begin(), globs.end(),
+                           [&name](const std::string& g) { return zip_glob_match(g, name); });
+    };
+    ZipSizeInfo info;
+    for (const auto& entry : zip.entries()) {
+        if (entry.is_dir || (!opts.include.empty() && !matches(opts.include, entry.name)) ||
+            matches(opts.exclude, entry.name))
+            continue;
+        if (!opts.reuse_dir.empty() && opts.can_share_inode) {
+            struct stat st;
+            if (lstat((opts.reuse_dir + "/" + entry.name).c_str(), &st) == 0 &&
+                S_ISREG(st.st_mode) && static_cast<uint64_t>(st.st_size) == entry.size &&
+                opts.can_share_inode(entry.name, st))
+                continue;
+        }
+        info.total += entry.size;
+        info.files++;
+        info.largest = std::max<uint64_t>(info.largest, entry.size);
+    }
+    return info;
+}
+
+// Check free space for the files an extraction writes and claim it with an unlinked, preallocated
+// placeholder, so a full /data is reported before extraction starts instead of halfway through.
+// Every file is rounded up to a whole block. On success *reserve_fd is the placeholder (or -1 if
+// the filesystem cannot preallocate); pass it as ZipExtractOptions::reserve_fd and close it after.
+static bool reserve_install_space(const std::string& dir, const ZipSizeInfo& info,
+                                  int* reserve_fd) {
+    *reserve_fd = -1;
+    struct statvfs vfs;
+    if (statvfs(dir.c_str(), &vfs) != 0) {
+        LOGW("statvfs %s failed: %s", dir.c_str(), strerror(errno));
+        return true;
+    }
+    uint64_t block = vfs.f_frsize ? vfs.f_frsize : vfs.f_bsize;
+    uint64_t need = info.total + static_cast<uint64_t>(info.files) * block;
+    uint64_t avail = static_cast<uint64_t>(vfs.f_bavail) * block;
+    LOGI("Module needs %llu bytes (%zu files, largest %llu), %llu available",
+         static_cast<unsigned long long>(need), info.files,
+         static_cast<unsigned long long>(info.largest), static_cast<unsigned long long>(avail));
+    if (need > avail) {
+        printf("! Not enough space: need %llu MB, %llu MB available\n",
+               static_cast<unsigned long long>(need >> 20),
+               static_cast<unsigned long long>(avail >> 20));
+        return false;
+    }
+    if (need == 0)
+        return true;
 
-    if (mod_id.empty()) {
-        printf("! Module ID not found in module.prop\n");
-        exec_command({"rm", "-rf", tmpdir});
+    // Unlinked right away: the space is held by the descriptor and freed if we crash
+    std::string placeholder = dir + "/.reserve";
+    int fd = open(placeholder.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0)
+        return true;
+    unlink(placeholder.c_str());
+    if (fallocate(fd, 0, 0, static_cast<off_t>(need)) != 0) {
+        int err = errno;
+        close(fd);
+        if (err == EOPNOTSUPP || err == ENOSYS)
+            return true;
+        printf("! Unable to reserve %llu MB for module files: %s\n",
+               static_cast<unsigned long long>(need >> 20), strerror(err));
         return false;
     }
+    *reserve_fd = fd;
+    return true;
+}
+
+// Native C++ module installation - replaces shell script
+static bool install_prepared_module(PreparedModule& mod, InstallContext& ctx, unsigned jobs) {
+    printf("- Extracting module files\n");
+
+    ZipArchive& zip = mod.zip;
+    const std::string& zipfile = mod.zipfile;
+    auto& props = mod.props;
+    const std::string& mod_id = mod.id;
+    std::string mod_name = props.count("name") ? props["name"] : "";
+    std::string mod_author = props.count("author") ? props["author"] : "";
 
     printf("\n");
     printf("******************************\n");
@@ -509,7 +834,7 @@ static bool exec_install_script(const std::string& zip_path) {
 
     // Check install safety for regular modules
     if (!installing_metamodule) {
-        int safety = check_install_safety(false);
+        int safety = ctx.safety;
         if (safety != 0) {
             printf("\n❌ Installation Blocked\n");
             printf("┌────────────────────────────────\n");
@@ -523,14 +848,13 @@ static bool exec_install_script(const std::string& zip_path) {
                 printf("│ Action required: Reboot to apply changes first\n");
             }
             printf("└─────────────────────────────────\n\n");
-            exec_command({"rm", "-rf", tmpdir});
             return false;
         }
     }
 
     // Check for duplicate metamodule
     if (installing_metamodule) {
-        std::string existing_id = get_metamodule_id();
+        const std::string& existing_id = ctx.metamodule_id;
         if (!existing_id.empty() && existing_id != mod_id) {
             printf("\n❌ Installation Failed\n");
             printf("┌────────────────────────────────\n");
@@ -544,70 +868,105 @@ static bool exec_install_script(const std::string& zip_path) {
             printf("│   2. Reboot your device\n");
             printf("│   3. Install the new metamodule\n");
             printf("└─────────────────────────────────\n\n");
-            exec_command({"rm", "-rf", tmpdir});
             return false;
         }
     }
 
-    // Determine module root path
+    // Determine module root path. The tree is built in a hidden sibling and swapped in once
+    // complete; handle_updated_modules() ignores dot entries, so a crash leaves nothing behind
+    // that could be applied.
     std::string modroot = std::string(MODULE_DIR) + "../modules_update";
-    exec_command({"mkdir", "-p", modroot});
+    mkdirs(modroot);
 
-    std::string modpath = modroot + "/" + mod_id;
-    exec_command({"rm", "-rf", modpath});
-    exec_command({"mkdir", "-p", modpath});
+    std::string final_path = modroot + "/" + mod_id;
+    std::string modpath = modroot + "/." + mod_id + ".staging";
+    remove_tree(modpath);
+    mkdirs(modpath);
 
     // Check for customize.sh to determine if we should skip extraction
-    result = exec_command({"unzip", "-o", "-q", zipfile, "customize.sh", "-d", modpath});
-
+    bool has_customize = zip.find("customize.sh") != nullptr;
     bool skip_unzip = false;
-    if (result.exit_code == 0 && file_exists(modpath + "/customize.sh")) {
-        // Check if customize.sh contains SKIPUNZIP=1
-        std::ifstream f(modpath + "/customize.sh");
-        std::string line;
-        while (std::getline(f, line)) {
-            if (line.find("SKIPUNZIP=1") != std::string::npos) {
-                skip_unzip = true;
-                break;
-            }
+    if (has_customize) {
+        auto customize = zip.read("customize.sh");
+        ZipExtractOptions customize_opts;
+        customize_opts.include = {"customize.sh"};
+        if (!customize || !zip.extract(modpath, customize_opts)) {
+            printf("! Failed to extract customize.sh\n");
+            remove_tree(modpath);
+            return false;
         }
+        skip_unzip = customize->find("SKIPUNZIP=1") != std::string::npos;
     }
 
-    if (!skip_unzip) {
+    // Extract everything except META-INF
+    ZipExtractOptions extract_opts;
+    extract_opts.exclude = {"META-INF/*"};
+    extract_opts.jobs = jobs;
+    // Updating an installed module: only changed or new members are actually written
+    std::string installed = std::string(MODULE_DIR) + mod_id;
+    if (!skip_unzip && file_exists(installed) &&
+        !file_exists(installed + "/" + REMOVE_FILE_NAME)) {
+        extract_opts.reuse_dir = installed;
+        // Hard links are safe only if nothing writes to the staged copy: no customize.sh,
+        // and set_perm_rules() would leave the installed file exactly as it is
+        if (!has_customize) {
+            extract_opts.can_share_inode = [&installed](const std::string& rel,
+                                                        const struct stat& st) {
+                const PermRule& rule = perm_rule_for(module_perm_rules(), rel);
+                return st.st_uid == rule.uid && st.st_gid == rule.gid &&
+                       (st.st_mode & 07777) == rule.file_mode &&
+                       lgetfilecon(installed + "/" + rel) == rule.secontext;
+            };
+        }
+    }
+
+    // Fail before writing anything if /data cannot hold the extracted tree; the claimed space
+    // is handed over to the files one by one as they are written
+    int reserve_fd = -1;
+    if (!reserve_install_space(modpath, extract_size_info(zip, extract_opts), &reserve_fd)) {
+        remove_tree(modpath);
+        return false;
+    }
+
+    if (skip_unzip) {
+        // customize.sh extracts the files itself, so the check above is all that can be done
+        if (reserve_fd >= 0)
+            close(reserve_fd);
+    } else {
         printf("- Extracting module files\n");
-        // Extract everything except META-INF
-        result = exec_command({"unzip", "-o", "-q", zipfile, "-x", "META-INF/*", "-d", modpath});
-        if (result.exit_code != 0) {
+        extract_opts.reserve_fd = reserve_fd;
+        ZipExtractStats stats;
+        bool extracted = zip.extract(modpath, extract_opts, &stats);
+        if (reserve_fd >= 0)
+            close(reserve_fd);
+        if (!extracted) {
             printf("! Failed to extract module files\n");
-            exec_command({"rm", "-rf", modpath});
-            exec_command({"rm", "-rf", tmpdir});
+            remove_tree(modpath);
             return false;
         }
-
-        // Set default permissions
-        printf("- Setting permissions\n");
-        set_perm_recursive(modpath, 0, 0, 0755, 0644);
-
-        // Special permissions for bin/xbin directories
-        std::string bin_dirs[] = {modpath + "/system/bin", modpath + "/system/xbin",
-                                  modpath + "/system/system_ext/bin"};
-        for (const auto& bindir : bin_dirs) {
-            if (file_exists(bindir))
-                set_perm_recursive(bindir, 0, 2000, 0755, 0755);
+        LOGI("Extracted %zu files, %zu dirs, %llu bytes", stats.files, stats.dirs,
+             static_cast<unsigned long long>(stats.bytes));
+        if (stats.reused > 0) {
+            printf("- Reused %zu unchanged files from installed version\n", stats.reused);
+            LOGI("Reused %zu unchanged files (%llu bytes)", stats.reused,
+                 static_cast<unsigned long long>(stats.reused_bytes));
         }
-
-        // Vendor directory with special secontext
-        std::string vendor_dir = modpath + "/system/vendor";
-        if (file_exists(vendor_dir))
-            set_perm_recursive(vendor_dir, 0, 2000, 0755, 0755, "u:object_r:vendor_file:s0");
+        printf("- Setting permissions\n");
+        const auto& perm_rules = module_perm_rules();
+        auto perm_start = std::chrono::steady_clock::now();
+        PermStats perm_stats = set_perm_rules(modpath, perm_rules);
+        auto perm_ms = std::chrono::duration_cast<std::chrono::milliseconds>(
+                           std::chrono::steady_clock::now() - perm_start)
+                           .count();
+        LOGI("Set permissions on %zu entries (%zu failed) in %lld ms", perm_stats.entries,
+             perm_stats.failed, static_cast<long long>(perm_ms));
     }
 
     // Execute customize.sh if present
     if (file_exists(modpath + "/customize.sh")) {
         if (!exec_customize_sh(modpath, zipfile)) {
             printf("! customize.sh failed\n");
-            exec_command({"rm", "-rf", modpath});
-            exec_command({"rm", "-rf", tmpdir});
+            remove_tree(modpath);
             return false;
         }
     }
@@ -618,35 +977,43 @@ static bool exec_install_script(const std::string& zip_path) {
     handle_partition(modpath, "product");
     handle_partition(modpath, "odm");
 
+    // Clean up installer-only files before the tree goes live
+    unlink((modpath + "/customize.sh").c_str());
+    unlink((modpath + "/README.md").c_str());
+
+    // Swap the finished tree in; a pending update it replaces is deleted in the background
+    if (!swap_in_module_tree(modpath, final_path)) {
+        printf("! Failed to stage module files\n");
+        remove_tree(modpath);
+        return false;
+    }
+    purge_module_trash();
+
     // Update existing module if in BOOTMODE
     std::string final_module = std::string(MODULE_DIR) + mod_id;
-    exec_command({"mkdir", "-p", std::string(MODULE_DIR)});
-    exec_command({"touch", final_module + "/update"});
-    exec_command({"rm", "-f", final_module + "/remove"});
-    exec_command({"rm", "-f", final_module + "/disable"});
-    exec_command({"cp", "-f", modpath + "/module.prop", final_module + "/module.prop"});
+    mkdirs(final_module);
+    touch_file(final_module + "/" + UPDATE_FILE_NAME);
+    unlink((final_module + "/" + REMOVE_FILE_NAME).c_str());
+    unlink((final_module + "/" + DISABLE_FILE_NAME).c_str());
+    copy_file_atomic(final_path + "/module.prop", final_module + "/module.prop");
 
     // Create metamodule symlink if needed
     if (installing_metamodule) {
         printf("- Creating metamodule symlink\n");
         if (!create_metamodule_symlink(mod_id)) {
             printf("! Failed to create metamodule symlink\n");
-            exec_command({"rm", "-rf", modpath});
-            exec_command({"rm", "-rf", tmpdir});
+            remove_tree(final_path);
             return false;
         }
+        ctx.metamodule_id = mod_id;
+        ctx.safety = check_install_safety(false);
     }
 
-    // Clean up
-    exec_command({"rm", "-f", modpath + "/customize.sh"});
-    exec_command({"rm", "-f", modpath + "/README.md"});
-    exec_command({"rm", "-rf", tmpdir});
-
     printf("- Done\n");
     return true;
 }
 
-int module_install(const std::string& zip_path) {
+int module_install(const std::vector<std::string>& zip_paths, unsigned jobs) {
     // Ensure stdout is unbuffered for real-time output
     setvbuf(stdout, nullptr, _IONBF, 0);
 
@@ -659,6 +1026,11 @@ int module_install(const std::string& zip_path) {
     printf("\n");
     fflush(stdout);  // Ensure banner is output before script execution
 
+    if (zip_paths.empty()) {
+        printf("! No module file given\n");
+        return 1;
+    }
+
     // Ensure binary assets (busybox, etc.) exist in current backend bin
     auto root_impl = read_file(ROOT_IMPL_CONFIG_PATH);
     std::string impl = root_impl ? trim(*root_impl) : "";
@@ -668,22 +1040,132 @@ int module_install(const std::string& zip_path) {
         return 1;
     }
 
-    LOGI("Installing module from %s", zip_path.c_str());
+    // "-" and /proc/self/fd/N name descriptors; take them over before anything reads them
+    std::vector<std::string> sources;
+    std::vector<int> received_fds;
+    auto close_received = [&received_fds]() {
+        for (int fd : received_fds)
+            close(fd);
+    };
+    for (const auto& zip_path : zip_paths) {
+        int src_fd = -1;
+        if (zip_path == "-") {
+            src_fd = STDIN_FILENO;
+        } else if (starts_with(zip_path, FD_PATH_PREFIX)) {
+            const char* num = zip_path.c_str() + strlen(FD_PATH_PREFIX);
+            char* end = nullptr;
+            long n = strtol(num, &end, 10);
+            if (end == num || *end != '\0' || n < 0 || n > INT_MAX) {
+                printf("! Invalid file descriptor: %s\n", zip_path.c_str());
+                close_received();
+                return 1;
+            }
+            src_fd = static_cast<int>(n);
+        } else {
+            sources.push_back(zip_path);
+            continue;
+        }
+        int fd = receive_module_fd(src_fd);
+        if (fd < 0) {
+            close_received();
+            return 1;
+        }
+        received_fds.push_back(fd);
+        sources.push_back(FD_PATH_PREFIX + std::to_string(fd));
+    }
 
-    // Check if zip file exists
-    if (!file_exists(zip_path)) {
-        printf("! Module file not found: %s\n", zip_path.c_str());
+    // Open every archive and parse its module.prop before anything is installed. Only the ids
+    // are kept, so a large batch does not hold every archive and central directory open.
+    struct Validation {
+        std::string id;
+        std::string error;
+    };
+    std::vector<Validation> checked(sources.size());
+    std::atomic<size_t> next_check{0};
+    auto check_worker = [&]() {
+        for (size_t i; (i = next_check.fetch_add(1)) < sources.size();) {
+            auto mod = prepare_module(sources[i]);
+            checked[i] = {mod->id, mod->error};
+        }
+    };
+    std::vector<std::thread> checkers;
+    size_t checker_count = std::min<size_t>(sources.size(), MODULE_CHECK_THREADS);
+    for (size_t i = 1; i < checker_count; i++)
+        checkers.emplace_back(check_worker);
+    check_worker();
+    for (auto& t : checkers)
+        t.join();
+
+    std::set<std::string> ids;
+    bool all_valid = true;
+    for (size_t i = 0; i < sources.size(); i++) {
+        if (!checked[i].error.empty()) {
+            printf("! %s: %s\n", sources[i].c_str(), checked[i].error.c_str());
+            all_valid = false;
+        } else if (!ids.insert(checked[i].id).second) {
+            printf("! Module %s is listed more than once\n", checked[i].id.c_str());
+            all_valid = false;
+        }
+    }
+    if (!all_valid) {
+        close_received();
         return 1;
     }
 
-    // Use the embedded installer script (same as Rust version)
-    if (!exec_install_script(zip_path)) {
-        printf("! Module installation failed\n");
-        return 1;
+    InstallContext ctx{check_install_safety(false), get_metamodule_id()};
+
+    struct InstallResult {
+        std::string zip_path;
+        std::string id;
+        bool ok;
+    };
+    std::vector<InstallResult> results;
+
+    // Parse the next archive's central directory while the current one is being written
+    auto next = std::async(std::launch::async, prepare_module, sources.front());
+    for (size_t i = 0; i < sources.size(); i++) {
+        auto mod = next.get();
+        if (i + 1 < sources.size()) {
+            next = std::async(std::launch::async, prepare_module, sources[i + 1]);
+        }
+
+        LOGI("Installing module from %s", mod->zip_path.c_str());
+
+        bool ok = false;
+        if (!mod->error.empty()) {
+            // The archive changed since it was checked
+            printf("! %s\n", mod->error.c_str());
+        } else {
+            ok = install_prepared_module(*mod, ctx, jobs);
+        }
+
+        if (ok) {
+            LOGI("Module installed successfully");
+        } else {
+            printf("! Module installation failed\n");
+        }
+        results.push_back({mod->zip_path, mod->id, ok});
     }
 
-    LOGI("Module installed successfully");
-    return 0;
+    size_t failed = 0;
+    for (const auto& r : results) {
+        if (!r.ok)
+            failed++;
+    }
+    if (results.size() > 1) {
+        printf("\n- Summary: %zu installed, %zu failed\n", results.size() - failed, failed);
+        for (const auto& r : results) {
+            printf("  %s %s (%s)\n", r.ok ? "[OK]  " : "[FAIL]",
+                   r.id.empty() ? "?" : r.id.c_str(), r.zip_path.c_str());
+        }
+    }
+
+    close_received();
+    return failed == 0 ? 0 : 1;
+}
+
+int module_install(const std::string& zip_path, unsigned jobs) {
+    return module_install(std::vector<std::string>{zip_path}, jobs);
 }
 
 int module_uninstall(const std::string& id) {
@@ -785,45 +1267,29 @@ int module_run_action(const std::string& id) {
 }
 
 int module_list() {
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir) {
-        // Empty JSON array
-        printf("[]\n");
-        return 0;
-    }
-
-    struct dirent* entry;
     std::vector<ModuleInfo> modules;
 
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
-
-        std::string module_path = std::string(MODULE_DIR) + entry->d_name;
-        std::string prop_path = module_path + "/module.prop";
-
-        if (!file_exists(prop_path))
+    for (const auto& m : module_index()) {
+        if (!m.has(MODULE_HAS_PROP))
             continue;
 
-        auto props = parse_module_prop(prop_path);
+        std::string module_path = m.path();
+        auto props = m.props;
 
         ModuleInfo info;
-        info.id = props.count("id") ? props["id"] : std::string(entry->d_name);
+        info.id = props.count("id") ? props["id"] : m.id;
         info.name = props.count("name") ? props["name"] : info.id;
         info.version = props.count("version") ? props["version"] : "";
         info.version_code = props.count("versionCode") ? props["versionCode"] : "";
         info.author = props.count("author") ? props["author"] : "";
         info.description = props.count("description") ? props["description"] : "";
-        info.enabled = !file_exists(module_path + "/" + DISABLE_FILE_NAME);
-        info.update = file_exists(module_path + "/" + UPDATE_FILE_NAME);
-        info.remove = file_exists(module_path + "/" + REMOVE_FILE_NAME);
-        info.web = file_exists(module_path + "/" + MODULE_WEB_DIR);
-        info.action = file_exists(module_path + "/" + MODULE_ACTION_SH);
+        info.enabled = !m.has(MODULE_DISABLED);
+        info.update = m.has(MODULE_UPDATE);
+        info.remove = m.has(MODULE_REMOVE);
+        info.web = m.has(MODULE_HAS_WEB);
+        info.action = m.has(MODULE_HAS_ACTION);
         // Check if module needs mounting (has system folder and no skip_mount)
-        info.mount =
-            file_exists(module_path + "/system") && !file_exists(module_path + "/skip_mount");
+        info.mount = m.has(MODULE_HAS_SYSTEM) && !m.has(MODULE_SKIP_MOUNT);
         // Check if module is a metamodule
         std::string metamodule_val = props.count("metamodule") ? props["metamodule"] : "";
         info.metamodule =
@@ -842,8 +1308,6 @@ int module_list() {
         modules.push_back(info);
     }
 
-    closedir(dir);
-
     // Output JSON array
     printf("[\n");
     for (size_t i = 0; i < modules.size(); i++) {
@@ -875,68 +1339,43 @@ int module_list() {
     return 0;
 }
 
-int uninstall_all_modules() {
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir)
-        return 0;
-
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
-
-        module_uninstall(entry->d_name);
-    }
+// Ids of all indexed modules; copied because the callers change the directory they describe
+static std::vector<std::string> indexed_module_ids() {
+    std::vector<std::string> ids;
+    for (const auto& m : module_index())
+        ids.push_back(m.id);
+    return ids;
+}
 
-    closedir(dir);
+int uninstall_all_modules() {
+    for (const auto& id : indexed_module_ids())
+        module_uninstall(id);
     return 0;
 }
 
 int prune_modules() {
     // Remove modules marked for removal
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir)
+    std::vector<std::string> removed;
+    for (const auto& m : module_index()) {
+        if (m.has(MODULE_REMOVE))
+            removed.push_back(m.id);
+    }
+    if (removed.empty())
         return 0;
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
-
-        std::string module_path = std::string(MODULE_DIR) + entry->d_name;
-        std::string remove_flag = module_path + "/" + REMOVE_FILE_NAME;
-
-        if (file_exists(remove_flag)) {
-            std::string cmd = "rm -rf " + module_path;
-            system(cmd.c_str());
-            LOGI("Removed module %s", entry->d_name);
-        }
+    for (const auto& id : removed) {
+        discard_module_tree(std::string(MODULE_DIR) + id);
+        LOGI("Removed module %s", id.c_str());
     }
 
-    closedir(dir);
+    module_index_invalidate();
+    purge_module_trash();
     return 0;
 }
 
 int disable_all_modules() {
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir)
-        return 0;
-
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
-
-        module_disable(entry->d_name);
-    }
-
-    closedir(dir);
+    for (const auto& id : indexed_module_ids())
+        module_disable(id);
     return 0;
 }
 
@@ -947,38 +1386,37 @@ int handle_updated_modules() {
     if (!dir)
         return 0;
 
+    // Collect first, the swaps below rename entries of the directory being read
+    std::vector<std::string> ids;
     struct dirent* entry;
     while ((entry = readdir(dir)) != nullptr) {
         if (entry->d_name[0] == '.')
             continue;
         if (entry->d_type != DT_DIR)
             continue;
+        ids.emplace_back(entry->d_name);
+    }
+    closedir(dir);
 
-        std::string src = update_dir + entry->d_name;
-        std::string dst = std::string(MODULE_DIR) + entry->d_name;
+    for (const auto& id : ids) {
+        std::string src = update_dir + id;
+        std::string dst = std::string(MODULE_DIR) + id;
 
-        // Remove old module if exists
-        if (file_exists(dst)) {
-            std::string cmd = "rm -rf " + dst;
-            system(cmd.c_str());
-        }
-
-        // Move updated module
-        if (rename(src.c_str(), dst.c_str()) == 0) {
-            LOGI("Updated module: %s", entry->d_name);
+        // Swap the updated module in; the old tree is deleted in the background
+        if (swap_in_module_tree(src, dst)) {
+            LOGI("Updated module: %s", id.c_str());
         } else {
-            LOGE("Failed to update module: %s", entry->d_name);
+            LOGE("Failed to update module: %s", id.c_str());
         }
     }
 
-    closedir(dir);
+    module_index_invalidate();
+    purge_module_trash();
     return 0;
 }
 
-static int run_script(const std::string& script, bool block, const std::string& module_id) {
-    if (!file_exists(script))
-        return 0;
-
+// Fork the script under busybox sh and return its pid, or -1 if fork failed
+static pid_t spawn_script(const std::string& script, const std::string& module_id) {
     LOGI("Running script: %s", script.c_str());
 
     // Use busybox for script execution (like Rust version)
@@ -1053,47 +1491,231 @@ static int run_script(const std::string& script, bool block, const std::string&
 
     if (pid < 0) {
         LOGE("Failed to fork for script: %s", script.c_str());
-        return -1;
     }
+    return pid;
+}
+
+static int run_script(const std::string& script, bool block, const std::string& module_id,
+                      const std::string& stage) {
+    if (!file_exists(script))
+        return 0;
+
+    int64_t start_ns = trace_now_ns();
+    pid_t pid = spawn_script(script, module_id);
+    if (pid < 0)
+        return -1;
 
     if (block) {
         int status;
-        waitpid(pid, &status, 0);
+        struct rusage usage;
+        int64_t deadline = stage.empty() ? INT64_MAX : script_deadline_ns(stage, start_ns);
+        if (!wait_script_until(pid, deadline, &status, &usage)) {
+            expire_script(pid, script, start_ns);
+            return -1;
+        }
+        trace_child(script, pid, start_ns, &usage);
         return WIFEXITED(status) ? WEXITSTATUS(status) : -1;
     }
 
     return 0;
 }
 
-int exec_stage_script(const std::string& stage, bool block) {
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir)
+// Exit check interval for running scripts when the kernel has no pidfd_open
+static constexpr int64_t SCRIPT_POLL_MS = 20;
+
+// One blocking-stage script for the parallel scheduler
+struct ScriptJob {
+    std::string script;
+    std::string module_id;           // empty for common scripts
+    bool serial = false;             // module.prop serial=1: runs with nothing else alongside
+    std::vector<std::string> after;  // module.prop after=<id>[,...]: starts once those finish
+    pid_t pid = -1;
+    int pidfd = -1;  // while running, if the kernel has pidfd_open
+    bool done = false;
+    int64_t start_ns = 0;
+    int64_t deadline_ns = INT64_MAX;
+};
+
+// Opt-in concurrency limit for blocking stages; 0 keeps the sequential behaviour
+static unsigned parallel_script_limit() {
+    auto content = read_file(PARALLEL_SCRIPTS_PATH);
+    if (!content)
         return 0;
+    unsigned limit = static_cast<unsigned>(strtoul(trim(*content).c_str(), nullptr, 10));
+    if (limit == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        limit = cpus > 0 ? static_cast<unsigned>(cpus) : 1;
+    }
+    return limit;
+}
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
+// Run the jobs with at most `limit` children at once and return when every one has exited or
+// ran past its script_limits() deadline. Jobs start in list order as soon as their after=
+// dependencies finished; a serial job waits for the pool to drain and holds it alone. Jobs
+// reached after the stage budget is spent are started without being waited for.
+static void run_scripts_parallel(std::vector<ScriptJob>& jobs, unsigned limit,
+                                 const std::string& stage) {
+    std::map<std::string, size_t> by_module;
+    for (size_t i = 0; i < jobs.size(); i++) {
+        if (!jobs[i].module_id.empty())
+            by_module[jobs[i].module_id] = i;
+    }
+    auto deps_done = [&](const ScriptJob& job) {
+        for (const auto& dep : job.after) {
+            auto it = by_module.find(dep);
+            if (it != by_module.end() && !jobs[it->second].done)
+                return false;
+        }
+        return true;
+    };
+
+    std::map<pid_t, size_t> running;
+    size_t started = 0;
+    size_t late_scripts = 0;
+    bool serial_running = false;
+    auto start = [&](ScriptJob& job, size_t idx) {
+        started++;
+        job.start_ns = trace_now_ns();
+        // Past the stage budget every script would expire right away; start it unwaited instead
+        bool late = stage_budget_spent(stage);
+        late_scripts += late;
+        job.pid = spawn_script(job.script, job.module_id);
+        if (job.pid < 0 || late) {
+            job.done = true;
+            return;
+        }
+        job.deadline_ns = script_deadline_ns(stage, job.start_ns);
+        job.pidfd = open_pidfd(job.pid);
+        running[job.pid] = idx;
+        serial_running = job.serial;
+    };
+    auto finish = [&](ScriptJob& job) {
+        if (job.pidfd >= 0)
+            close(job.pidfd);
+        job.pidfd = -1;
+        job.done = true;
+        if (job.serial)
+            serial_running = false;
+    };
+
+    while (started < jobs.size() || !running.empty()) {
+        bool launched = false;
+        for (size_t i = 0; i < jobs.size() && !serial_running && running.size() < limit; i++) {
+            ScriptJob& job = jobs[i];
+            if (job.pid >= 0 || job.done || !deps_done(job))
+                continue;
+            if (job.serial && !running.empty())
+                break;
+            start(job, i);
+            launched = true;
+        }
+
+        if (running.empty()) {
+            if (launched || started == jobs.size())
+                continue;
+            // Nothing runnable and nothing to wait for: an after= cycle, break it in list order
+            for (size_t i = 0; i < jobs.size(); i++) {
+                if (jobs[i].pid < 0 && !jobs[i].done) {
+                    LOGW("Dependency cycle at %s, starting it anyway", jobs[i].script.c_str());
+                    start(jobs[i], i);
+                    break;
+                }
+            }
             continue;
+        }
 
-        std::string module_id = entry->d_name;
-        std::string module_path = std::string(MODULE_DIR) + module_id;
+        // Only the stage's own scripts are waited for: log captures and scripts left behind by
+        // expire_script() have their own waiters. A pidfd per job makes the wait exact; without
+        // pidfd support the running pids are polled.
+        std::vector<struct pollfd> pfds;
+        int64_t deadline = INT64_MAX;
+        for (const auto& [pid, idx] : running) {
+            if (jobs[idx].pidfd >= 0)
+                pfds.push_back({jobs[idx].pidfd, POLLIN, 0});
+            deadline = std::min(deadline, jobs[idx].deadline_ns);
+        }
+        int64_t wait_ms = -1;
+        if (deadline != INT64_MAX)
+            wait_ms = std::clamp<int64_t>((deadline - trace_now_ns() + 999999) / 1000000, 0,
+                                          INT_MAX);
+        if (pfds.size() != running.size()) {
+            pfds.clear();
+            wait_ms = wait_ms < 0 ? SCRIPT_POLL_MS : std::min<int64_t>(wait_ms, SCRIPT_POLL_MS);
+        }
+        if (poll(pfds.data(), pfds.size(), static_cast<int>(wait_ms)) < 0 && errno != EINTR) {
+            LOGE("poll failed: %s", strerror(errno));
+            break;
+        }
 
-        // Skip disabled modules
-        if (file_exists(module_path + "/" + DISABLE_FILE_NAME))
-            continue;
+        int64_t now = trace_now_ns();
+        for (auto it = running.begin(); it != running.end();) {
+            ScriptJob& job = jobs[it->second];
+            int status;
+            struct rusage usage;
+            pid_t ret = wait4(job.pid, &status, WNOHANG, &usage);
+            if (ret == job.pid) {
+                trace_child(job.script, job.pid, job.start_ns, &usage);
+            } else if (ret < 0 && errno != EINTR) {
+                LOGE("wait4 %d failed: %s", job.pid, strerror(errno));
+            } else if (job.deadline_ns <= now) {
+                expire_script(job.pid, job.script, job.start_ns);
+            } else {
+                ++it;
+                continue;
+            }
+            finish(job);
+            it = running.erase(it);
+        }
+    }
+    log_late_scripts(stage, late_scripts);
+}
 
-        // Skip modules marked for removal
-        if (file_exists(module_path + "/" + REMOVE_FILE_NAME))
+int exec_stage_script(const std::string& stage, bool block) {
+    unsigned limit = block ? parallel_script_limit() : 0;
+    if (limit > 0) {
+        std::vector<ScriptJob> jobs;
+        for (const auto& m : module_index()) {
+            if (m.has(MODULE_DISABLED) || m.has(MODULE_REMOVE) || !m.has_stage_script(stage))
+                continue;
+            ScriptJob job;
+            job.script = m.path() + "/" + stage + ".sh";
+            job.module_id = m.id;
+            auto serial = m.props.find("serial");
+            job.serial =
+                serial != m.props.end() && (serial->second == "1" || serial->second == "true");
+            auto after = m.props.find("after");
+            if (after != m.props.end()) {
+                for (auto& dep : split(after->second, ',')) {
+                    dep = trim(dep);
+                    if (!dep.empty())
+                        job.after.push_back(dep);
+                }
+            }
+            jobs.push_back(std::move(job));
+        }
+        LOGI("Running %zu %s scripts, up to %u at once", jobs.size(), stage.c_str(), limit);
+        run_scripts_parallel(jobs, limit, stage);
+        // The scripts may have disabled, removed or edited modules
+        module_index_invalidate();
+        return 0;
+    }
+
+    size_t late_scripts = 0;
+    for (const auto& m : module_index()) {
+        // Skip disabled modules and modules marked for removal
+        if (m.has(MODULE_DISABLED) || m.has(MODULE_REMOVE))
+            continue;
+        if (!m.has_stage_script(stage))
             continue;
 
         // Run stage script with module_id for KSU_MODULE env var
-        std::string script = module_path + "/" + stage + ".sh";
-        run_script(script, block, module_id);
+        bool late = block && stage_budget_spent(stage);
+        late_scripts += late;
+        run_script(m.path() + "/" + stage + ".sh", block && !late, m.id, stage);
     }
+    log_late_scripts(stage, late_scripts);
+    module_index_invalidate();
 
-    closedir(dir);
     return 0;
 }
 
@@ -1103,6 +1725,14 @@ int exec_common_scripts(const std::string& stage_dir, bool block) {
     if (!dir)
         return 0;
 
+    unsigned limit = block ? parallel_script_limit() : 0;
+    std::vector<ScriptJob> jobs;
+    // post-fs-data.d belongs to the post-fs-data stage and shares its time budget
+    std::string stage = stage_dir;
+    if (stage.size() > 2 && stage.compare(stage.size() - 2, 2, ".d") == 0)
+        stage.resize(stage.size() - 2);
+
+    size_t late_scripts = 0;
     struct dirent* entry;
     while ((entry = readdir(dir)) != nullptr) {
         if (entry->d_name[0] == '.')
@@ -1116,36 +1746,39 @@ int exec_common_scripts(const std::string& stage_dir, bool block) {
             continue;
 
         std::string script = dir_path + name;
-        run_script(script, block);
+        if (limit > 0) {
+            ScriptJob job;
+            job.script = script;
+            jobs.push_back(std::move(job));
+            continue;
+        }
+        bool late = block && stage_budget_spent(stage);
+        late_scripts += late;
+        run_script(script, block && !late, "", stage);
     }
 
     closedir(dir);
+    log_late_scripts(stage, late_scripts);
+
+    if (limit > 0 && !jobs.empty()) {
+        // readdir order is arbitrary; start the pool in name order like the shell glob would
+        std::sort(jobs.begin(), jobs.end(),
+                  [](const ScriptJob& a, const ScriptJob& b) { return a.script < b.script; });
+        run_scripts_parallel(jobs, limit, stage);
+    }
+    // Common scripts can change modules as well
+    module_index_invalidate();
     return 0;
 }
 
-int load_sepolicy_rule() {
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir)
-        return 0;
-
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
-
-        std::string module_path = std::string(MODULE_DIR) + entry->d_name;
-
+void collect_sepolicy_rules(std::vector<SepolicySource>& out) {
+    for (const auto& m : module_index()) {
         // Skip disabled modules
-        if (file_exists(module_path + "/" + DISABLE_FILE_NAME))
+        if (m.has(MODULE_DISABLED) || !m.has(MODULE_HAS_SEPOLICY_RULE))
             continue;
 
-        std::string rule_file = module_path + "/sepolicy.rule";
-        if (!file_exists(rule_file))
-            continue;
+        std::string rule_file = m.path() + "/sepolicy.rule";
 
-        // Read and apply rules
         std::ifstream ifs(rule_file);
         std::string line;
         std::string all_rules;
@@ -1157,50 +1790,30 @@ int load_sepolicy_rule() {
         }
 
         if (!all_rules.empty()) {
-            LOGI("Applying sepolicy rules from %s", entry->d_name);
-            int ret = sepolicy_live_patch(all_rules);
-            if (ret != 0) {
-                LOGW("Failed to apply some sepolicy rules from %s", entry->d_name);
-            }
+            out.push_back({m.id, std::move(all_rules)});
         }
     }
-
-    closedir(dir);
-    return 0;
 }
 
 int load_system_prop() {
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir)
-        return 0;
-
     // Check if resetprop exists
     if (!file_exists(RESETPROP_PATH)) {
         LOGW("resetprop not found at %s, skipping system.prop loading", RESETPROP_PATH);
-        closedir(dir);
         return 0;
     }
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
-
-        std::string module_path = std::string(MODULE_DIR) + entry->d_name;
-
+    // Collect every module's properties first; a later module overrides an earlier one
+    std::vector<std::pair<std::string, std::string>> props;
+    std::map<std::string, std::pair<size_t, std::string>> owner;  // key -> (index, module id)
+    for (const auto& m : module_index()) {
         // Skip disabled modules
-        if (file_exists(module_path + "/" + DISABLE_FILE_NAME))
+        if (m.has(MODULE_DISABLED) || !m.has(MODULE_HAS_SYSTEM_PROP))
             continue;
 
-        std::string prop_file = module_path + "/system.prop";
-        if (!file_exists(prop_file))
-            continue;
+        std::string prop_file = m.path() + "/system.prop";
 
-        LOGI("Loading system.prop from %s", entry->d_name);
+        LOGI("Loading system.prop from %s", m.id.c_str());
 
-        // Read and set properties
         std::ifstream ifs(prop_file);
         std::string line;
         while (std::getline(ifs, line)) {
@@ -1215,20 +1828,28 @@ int load_system_prop() {
             std::string key = trim(line.substr(0, eq));
             std::string value = trim(line.substr(eq + 1));
 
-            // Execute resetprop with full path
-            pid_t pid = fork();
-            if (pid == 0) {
-                execl(RESETPROP_PATH, "resetprop", "-n", key.c_str(), value.c_str(), nullptr);
-                _exit(127);
+            auto it = owner.find(key);
+            if (it == owner.end()) {
+                owner.emplace(key, std::make_pair(props.size(), m.id));
+                props.emplace_back(std::move(key), std::move(value));
+                continue;
             }
-            if (pid > 0) {
-                int status;
-                waitpid(pid, &status, 0);
+            auto& [index, prev_id] = it->second;
+            if (prev_id != m.id) {
+                LOGI("system.prop: %s=%s from %s overrides %s", key.c_str(), value.c_str(),
+                     m.id.c_str(), prev_id.c_str());
+                prev_id = m.id;
             }
+            props[index].second = std::move(value);
         }
     }
 
-    closedir(dir);
+    if (props.empty())
+        return 0;
+    LOGI("Setting %zu properties from system.prop", props.size());
+    if (!resetprop_batch(props)) {
+        LOGW("Failed to set some system.prop properties");
+    }
     return 0;
 }
 
@@ -1284,27 +1905,13 @@ static std::map<std::string, std::string> merge_module_configs(const std::string
 std::map<std::string, std::vector<std::string>> get_managed_features() {
     std::map<std::string, std::vector<std::string>> managed_features_map;
 
-    DIR* dir = opendir(MODULE_DIR);
-    if (!dir) {
-        return managed_features_map;
-    }
-
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        if (entry->d_name[0] == '.')
-            continue;
-        if (entry->d_type != DT_DIR)
-            continue;
-
-        std::string module_id = entry->d_name;
-        std::string module_path = std::string(MODULE_DIR) + module_id;
-
+    for (const auto& m : module_index()) {
         // Check if module is active (not disabled/removed)
-        if (file_exists(module_path + "/disable"))
-            continue;
-        if (file_exists(module_path + "/remove"))
+        if (m.has(MODULE_DISABLED) || m.has(MODULE_REMOVE))
             continue;
 
+        const std::string& module_id = m.id;
+
         // Read module config
         auto config = merge_module_configs(module_id);
 
@@ -1325,7 +1932,6 @@ std::map<std::string, std::vector<std::string>> get_managed_features() {
         }
     }
 
-    closedir(dir);
     return managed_features_map;
 }
 
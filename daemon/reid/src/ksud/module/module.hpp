@@ -6,8 +6,16 @@
 
 namespace ksud {
 
+struct SepolicySource;
+
 // Module management
-int module_install(const std::string& zip_path);
+// jobs: extraction worker threads, 0 = number of online CPUs
+int module_install(const std::string& zip_path, unsigned jobs = 0);
+// Install several modules in one run: every archive and its module.prop id is checked before
+// the first install, metamodule state is sampled once, and each archive's central directory is
+// parsed while the previous one is being extracted.
+// "-" reads an archive from stdin and /proc/self/fd/N from an inherited descriptor.
+int module_install(const std::vector<std::string>& zip_paths, unsigned jobs = 0);
 int module_uninstall(const std::string& id);
 int module_undo_uninstall(const std::string& id);
 int module_enable(const std::string& id);
@@ -24,7 +32,8 @@ int handle_updated_modules();
 // Script execution
 int exec_stage_script(const std::string& stage, bool block);
 int exec_common_scripts(const std::string& stage_dir, bool block);
-int load_sepolicy_rule();
+// Append the sepolicy.rule of every enabled module
+void collect_sepolicy_rules(std::vector<SepolicySource>& out);
 int load_system_prop();
 
 // Get all managed features from active modules
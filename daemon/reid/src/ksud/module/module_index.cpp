@@ -0,0 +1,319 @@
+#include "module_index.hpp"
+#include "../../defs.hpp"
+#include "../../log.hpp"
+#include "../../utils.hpp"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <sstream>
+#include <unordered_map>
+
+namespace ksud {
+
+static constexpr uint32_t INDEX_MAGIC = 0x31494D52;  // "RMI1"
+static constexpr uint32_t INDEX_VERSION = 1;
+
+struct IndexState {
+    bool valid = false;
+    std::vector<ModuleRecord> modules;
+};
+
+static IndexState g_index;
+// Boot steps may read the table from several threads; only the first one builds it
+static std::mutex g_index_mutex;
+
+static int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+static FileStamp stamp_at(int dirfd, const std::string& name) {
+    struct stat st;
+    if (fstatat(dirfd, name.c_str(), &st, 0) != 0 || !S_ISREG(st.st_mode))
+        return {};
+    return {static_cast<uint64_t>(st.st_size), mtime_ns(st)};
+}
+
+static uint32_t flag_for_name(const char* name) {
+    static const std::pair<const char*, uint32_t> names[] = {
+        {DISABLE_FILE_NAME, MODULE_DISABLED},
+        {REMOVE_FILE_NAME, MODULE_REMOVE},
+        {UPDATE_FILE_NAME, MODULE_UPDATE},
+        {"skip_mount", MODULE_SKIP_MOUNT},
+        {"system", MODULE_HAS_SYSTEM},
+        {MODULE_WEB_DIR, MODULE_HAS_WEB},
+        {MODULE_ACTION_SH, MODULE_HAS_ACTION},
+        {"module.prop", MODULE_HAS_PROP},
+        {"system.prop", MODULE_HAS_SYSTEM_PROP},
+        {"sepolicy.rule", MODULE_HAS_SEPOLICY_RULE},
+        {"post-fs-data.sh", MODULE_SCRIPT_POST_FS_DATA},
+        {"post-mount.sh", MODULE_SCRIPT_POST_MOUNT},
+        {"service.sh", MODULE_SCRIPT_SERVICE},
+        {"boot-completed.sh", MODULE_SCRIPT_BOOT_COMPLETED},
+    };
+    for (const auto& [n, flag] : names) {
+        if (strcmp(name, n) == 0)
+            return flag;
+    }
+    return 0;
+}
+
+// Read one module directory: a single readdir for the flags, stats only for cached files
+static bool scan_module(int root_fd, const std::string& id, int64_t dir_mtime, ModuleRecord& rec) {
+    int fd = openat(root_fd, id.c_str(), O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0)
+        return false;
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return false;
+    }
+
+    rec = {};
+    rec.id = id;
+    rec.dir_mtime_ns = dir_mtime;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        rec.flags |= flag_for_name(entry->d_name);
+    }
+
+    if (rec.has(MODULE_HAS_PROP)) {
+        rec.module_prop = stamp_at(fd, "module.prop");
+        auto content = read_file(rec.path() + "/module.prop");
+        if (content)
+            rec.props = parse_module_prop_content(*content);
+    }
+    if (rec.has(MODULE_HAS_SYSTEM_PROP))
+        rec.system_prop = stamp_at(fd, "system.prop");
+    if (rec.has(MODULE_HAS_SEPOLICY_RULE))
+        rec.sepolicy_rule = stamp_at(fd, "sepolicy.rule");
+
+    closedir(dir);
+    return true;
+}
+
+// Files rewritten in place do not touch the directory mtime, so their own stamps are checked
+static bool record_current(int root_fd, const ModuleRecord& rec, int64_t dir_mtime) {
+    if (rec.dir_mtime_ns != dir_mtime)
+        return false;
+    if (rec.has(MODULE_HAS_PROP) && stamp_at(root_fd, rec.id + "/module.prop") != rec.module_prop)
+        return false;
+    if (rec.has(MODULE_HAS_SYSTEM_PROP) &&
+        stamp_at(root_fd, rec.id + "/system.prop") != rec.system_prop)
+        return false;
+    if (rec.has(MODULE_HAS_SEPOLICY_RULE) &&
+        stamp_at(root_fd, rec.id + "/sepolicy.rule") != rec.sepolicy_rule)
+        return false;
+    return true;
+}
+
+// Serialization: little-endian fixed-width integers and length-prefixed strings
+static void put_u32(std::string& out, uint32_t v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void put_u64(std::string& out, uint64_t v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+static void put_str(std::string& out, const std::string& s) {
+    put_u32(out, static_cast<uint32_t>(s.size()));
+    out.append(s);
+}
+
+static void put_stamp(std::string& out, const FileStamp& st) {
+    put_u64(out, st.size);
+    put_u64(out, static_cast<uint64_t>(st.mtime_ns));
+}
+
+struct Reader {
+    const std::string& data;
+    size_t pos = 0;
+
+    bool take(void* dst, size_t len) {
+        if (data.size() - pos < len)
+            return false;
+        memcpy(dst, data.data() + pos, len);
+        pos += len;
+        return true;
+    }
+    bool u32(uint32_t& v) { return take(&v, sizeof(v)); }
+    bool u64(uint64_t& v) { return take(&v, sizeof(v)); }
+    bool i64(int64_t& v) { return take(&v, sizeof(v)); }
+    bool str(std::string& s) {
+        uint32_t len;
+        if (!u32(len) || data.size() - pos < len)
+            return false;
+        s.assign(data, pos, len);
+        pos += len;
+        return true;
+    }
+    bool stamp(FileStamp& st) { return u64(st.size) && i64(st.mtime_ns); }
+};
+
+static std::string serialize(const std::vector<ModuleRecord>& modules) {
+    std::string out;
+    put_u32(out, INDEX_MAGIC);
+    put_u32(out, INDEX_VERSION);
+    put_u32(out, static_cast<uint32_t>(modules.size()));
+    for (const auto& m : modules) {
+        put_str(out, m.id);
+        put_u64(out, static_cast<uint64_t>(m.dir_mtime_ns));
+        put_u32(out, m.flags);
+        put_stamp(out, m.module_prop);
+        put_stamp(out, m.system_prop);
+        put_stamp(out, m.sepolicy_rule);
+        put_u32(out, static_cast<uint32_t>(m.props.size()));
+        for (const auto& [k, v] : m.props) {
+            put_str(out, k);
+            put_str(out, v);
+        }
+    }
+    return out;
+}
+
+static bool deserialize(const std::string& data, std::vector<ModuleRecord>& modules) {
+    Reader r{data};
+    uint32_t magic, version, count;
+    if (!r.u32(magic) || !r.u32(version) || !r.u32(count))
+        return false;
+    if (magic != INDEX_MAGIC || version != INDEX_VERSION)
+        return false;
+
+    for (uint32_t i = 0; i < count; i++) {
+        ModuleRecord m;
+        uint32_t nprops;
+        if (!r.str(m.id) || !r.i64(m.dir_mtime_ns) || !r.u32(m.flags) || !r.stamp(m.module_prop) ||
+            !r.stamp(m.system_prop) || !r.stamp(m.sepolicy_rule) || !r.u32(nprops))
+            return false;
+        for (uint32_t j = 0; j < nprops; j++) {
+            std::string k, v;
+            if (!r.str(k) || !r.str(v))
+                return false;
+            m.props.emplace(std::move(k), std::move(v));
+        }
+        modules.push_back(std::move(m));
+    }
+    return r.pos == data.size();
+}
+
+static void save_index(const std::vector<ModuleRecord>& modules) {
+    std::string tmp = std::string(MODULE_INDEX_PATH) + ".tmp";
+    if (!write_file(tmp, serialize(modules)) || rename(tmp.c_str(), MODULE_INDEX_PATH) != 0) {
+        LOGW("Failed to save module index: %s", strerror(errno));
+        unlink(tmp.c_str());
+    }
+}
+
+static void refresh_index() {
+    g_index.modules.clear();
+    g_index.valid = true;
+
+    std::vector<ModuleRecord> cached;
+    if (auto data = read_file(MODULE_INDEX_PATH)) {
+        if (!deserialize(*data, cached)) {
+            LOGW("Module index is corrupt, rebuilding");
+            cached.clear();
+        }
+    }
+
+    int root_fd = open(MODULE_DIR, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0)
+        return;
+    DIR* root = fdopendir(root_fd);
+    if (!root) {
+        close(root_fd);
+        return;
+    }
+
+    std::unordered_map<std::string, size_t> by_id;
+    for (size_t i = 0; i < cached.size(); i++)
+        by_id.emplace(cached[i].id, i);
+
+    size_t rescanned = 0;
+    struct dirent* entry;
+    while ((entry = readdir(root)) != nullptr) {
+        if (entry->d_name[0] == '.')
+            continue;
+        if (entry->d_type != DT_DIR && entry->d_type != DT_UNKNOWN)
+            continue;
+
+        struct stat st;
+        if (fstatat(root_fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0 ||
+            !S_ISDIR(st.st_mode))
+            continue;
+
+        std::string id = entry->d_name;
+        auto it = by_id.find(id);
+        if (it != by_id.end() && record_current(root_fd, cached[it->second], mtime_ns(st))) {
+            g_index.modules.push_back(std::move(cached[it->second]));
+            continue;
+        }
+        ModuleRecord rec;
+        if (scan_module(root_fd, id, mtime_ns(st), rec)) {
+            g_index.modules.push_back(std::move(rec));
+            rescanned++;
+        }
+    }
+    closedir(root);
+
+    std::sort(g_index.modules.begin(), g_index.modules.end(),
+              [](const ModuleRecord& a, const ModuleRecord& b) { return a.id < b.id; });
+
+    // Persist only when something moved: a rescan, or modules that disappeared
+    if (rescanned > 0 || g_index.modules.size() != cached.size()) {
+        LOGD("Module index: %zu modules, %zu rescanned", g_index.modules.size(), rescanned);
+        save_index(g_index.modules);
+    }
+}
+
+std::string ModuleRecord::path() const {
+    return std::string(MODULE_DIR) + id;
+}
+
+bool ModuleRecord::has_stage_script(const std::string& stage) const {
+    if (stage == "post-fs-data")
+        return has(MODULE_SCRIPT_POST_FS_DATA);
+    if (stage == "post-mount")
+        return has(MODULE_SCRIPT_POST_MOUNT);
+    if (stage == "service")
+        return has(MODULE_SCRIPT_SERVICE);
+    if (stage == "boot-completed")
+        return has(MODULE_SCRIPT_BOOT_COMPLETED);
+    return access((path() + "/" + stage + ".sh").c_str(), F_OK) == 0;
+}
+
+const std::vector<ModuleRecord>& module_index() {
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    if (!g_index.valid)
+        refresh_index();
+    return g_index.modules;
+}
+
+void module_index_invalidate() {
+    std::lock_guard<std::mutex> lock(g_index_mutex);
+    g_index.valid = false;
+    g_index.modules.clear();
+}
+
+std::map<std::string, std::string> parse_module_prop_content(const std::string& content) {
+    std::map<std::string, std::string> props;
+    std::istringstream iss(content);
+    std::string line;
+    while (std::getline(iss, line)) {
+        size_t eq = line.find('=');
+        if (eq != std::string::npos) {
+            std::string key = trim(line.substr(0, eq));
+            std::string value = trim(line.substr(eq + 1));
+            props[key] = value;
+        }
+    }
+
+    return props;
+}
+
+}  // namespace ksud
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+
+namespace ksud {
+
+// Per-module state, collected from a single readdir of the module directory
+enum ModuleFlag : uint32_t {
+    MODULE_DISABLED = 1u << 0,
+    MODULE_REMOVE = 1u << 1,
+    MODULE_UPDATE = 1u << 2,
+    MODULE_SKIP_MOUNT = 1u << 3,
+    MODULE_HAS_SYSTEM = 1u << 4,
+    MODULE_HAS_WEB = 1u << 5,
+    MODULE_HAS_ACTION = 1u << 6,
+    MODULE_HAS_PROP = 1u << 7,
+    MODULE_HAS_SYSTEM_PROP = 1u << 8,
+    MODULE_HAS_SEPOLICY_RULE = 1u << 9,
+    MODULE_SCRIPT_POST_FS_DATA = 1u << 10,
+    MODULE_SCRIPT_POST_MOUNT = 1u << 11,
+    MODULE_SCRIPT_SERVICE = 1u << 12,
+    MODULE_SCRIPT_BOOT_COMPLETED = 1u << 13,
+};
+
+// Size and mtime of a file whose contents are cached or consumed from the index
+struct FileStamp {
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+
+    bool operator==(const FileStamp& o) const { return size == o.size && mtime_ns == o.mtime_ns; }
+    bool operator!=(const FileStamp& o) const { return !(*this == o); }
+};
+
+struct ModuleRecord {
+    std::string id;  // directory name below MODULE_DIR
+    int64_t dir_mtime_ns = 0;
+    uint32_t flags = 0;
+    FileStamp module_prop;
+    FileStamp system_prop;
+    FileStamp sepolicy_rule;
+    std::map<std::string, std::string> props;  // parsed module.prop
+
+    bool has(uint32_t flag) const { return (flags & flag) != 0; }
+    std::string path() const;
+    // Whether <stage>.sh exists; stages without a flag fall back to a stat
+    bool has_stage_script(const std::string& stage) const;
+};
+
+// All module directories below MODULE_DIR, sorted by id.
+// The table is persisted at MODULE_INDEX_PATH and revalidated on first use by comparing
+// directory mtimes and the stamps of module.prop, system.prop and sepolicy.rule; only modules
+// that changed are re-read. The returned reference stays valid until module_index_invalidate(),
+// which must not race with readers.
+const std::vector<ModuleRecord>& module_index();
+
+// Forget the in-memory table after this process renamed or removed module directories, and
+// after each script stage, since module scripts may disable, remove or edit modules
+void module_index_invalidate();
+
+std::map<std::string, std::string> parse_module_prop_content(const std::string& content);
+
+}  // namespace ksud
@@ -0,0 +1,164 @@
+#include "script_limits.hpp"
+#include "../../core/boot_trace.hpp"
+#include "../../defs.hpp"
+#include "../../log.hpp"
+#include "../../utils.hpp"
+
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cinttypes>
+#include <climits>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <thread>
+
+#ifndef __NR_pidfd_open
+#define __NR_pidfd_open 434
+#endif
+
+namespace ksud {
+
+static int64_t parse_seconds_ms(const std::string& value) {
+    double sec = strtod(value.c_str(), nullptr);
+    return sec > 0 ? static_cast<int64_t>(sec * 1000.0) : 0;
+}
+
+static ScriptLimits load_script_limits() {
+    ScriptLimits limits;
+    auto content = read_file(SCRIPT_LIMITS_PATH);
+    if (!content)
+        return limits;
+
+    for (const auto& line : split(*content, '\n')) {
+        auto eq = line.find('=');
+        if (eq == std::string::npos)
+            continue;
+        std::string key = trim(line.substr(0, eq));
+        std::string value = trim(line.substr(eq + 1));
+        if (key == "script_timeout") {
+            limits.script_timeout_ms = parse_seconds_ms(value);
+        } else if (key == "stage_budget") {
+            limits.stage_budget_ms = parse_seconds_ms(value);
+        } else if (key == "on_timeout") {
+            limits.on_timeout =
+                value == "kill" ? ScriptTimeoutAction::Kill : ScriptTimeoutAction::Background;
+        }
+    }
+    return limits;
+}
+
+const ScriptLimits& script_limits() {
+    static const ScriptLimits limits = load_script_limits();
+    return limits;
+}
+
+// trace_now_ns() of the first script of each stage
+static std::mutex g_stage_mutex;
+static std::map<std::string, int64_t> g_stage_start;
+
+int64_t script_deadline_ns(const std::string& stage, int64_t start_ns) {
+    const auto& limits = script_limits();
+    int64_t deadline = INT64_MAX;
+    if (limits.script_timeout_ms > 0)
+        deadline = start_ns + limits.script_timeout_ms * 1000000LL;
+    if (limits.stage_budget_ms > 0) {
+        std::lock_guard<std::mutex> lock(g_stage_mutex);
+        int64_t first = g_stage_start.emplace(stage, start_ns).first->second;
+        deadline = std::min<int64_t>(deadline, first + limits.stage_budget_ms * 1000000LL);
+    }
+    return deadline;
+}
+
+bool stage_budget_spent(const std::string& stage) {
+    const auto& limits = script_limits();
+    if (limits.stage_budget_ms <= 0)
+        return false;
+    std::lock_guard<std::mutex> lock(g_stage_mutex);
+    auto it = g_stage_start.find(stage);
+    return it != g_stage_start.end() &&
+           trace_now_ns() >= it->second + limits.stage_budget_ms * 1000000LL;
+}
+
+void log_late_scripts(const std::string& stage, size_t count) {
+    if (count > 0)
+        LOGW("%s stage budget spent, started %zu more scripts without waiting for them",
+             stage.c_str(), count);
+}
+
+int open_pidfd(pid_t pid) {
+    int fd = static_cast<int>(syscall(__NR_pidfd_open, pid, 0));
+    if (fd < 0 && errno == ENOSYS) {
+        static std::atomic<bool> warned{false};
+        if (!warned.exchange(true))
+            LOGW("pidfd_open not supported, script time limits are disabled");
+    }
+    return fd;
+}
+
+static pid_t wait4_retry(pid_t pid, int* status, int options, struct rusage* usage) {
+    pid_t ret;
+    do {
+        ret = wait4(pid, status, options, usage);
+    } while (ret < 0 && errno == EINTR);
+    return ret;
+}
+
+bool wait_script_until(pid_t pid, int64_t deadline_ns, int* status, struct rusage* usage) {
+    int pidfd = deadline_ns == INT64_MAX ? -1 : open_pidfd(pid);
+    if (pidfd < 0) {
+        wait4_retry(pid, status, 0, usage);
+        return true;
+    }
+
+    // The pidfd becomes readable when the child exits, so a well-behaved script costs one poll
+    bool exited = false;
+    while (true) {
+        int64_t left_ns = deadline_ns - trace_now_ns();
+        if (left_ns <= 0)
+            break;
+        struct pollfd pfd = {pidfd, POLLIN, 0};
+        int timeout_ms = static_cast<int>(std::min<int64_t>((left_ns + 999999) / 1000000, INT_MAX));
+        int ret = poll(&pfd, 1, timeout_ms);
+        if (ret < 0 && errno == EINTR)
+            continue;
+        if (ret != 0) {
+            exited = true;
+            break;
+        }
+    }
+    close(pidfd);
+
+    if (exited)
+        wait4_retry(pid, status, 0, usage);
+    return exited;
+}
+
+void expire_script(pid_t pid, const std::string& script, int64_t start_ns) {
+    bool kill_it = script_limits().on_timeout == ScriptTimeoutAction::Kill;
+    int64_t elapsed_ms = (trace_now_ns() - start_ns) / 1000000;
+    LOGW("Script %s still running after %" PRId64 " ms, %s", script.c_str(), elapsed_ms,
+         kill_it ? "killing it" : "continuing it in the background");
+    // Scripts run in their own session (setsid), so the group takes their children along
+    if (kill_it)
+        kill(-pid, SIGKILL);
+    trace_child(script + (kill_it ? " (killed)" : " (backgrounded)"), pid, start_ns, nullptr);
+
+    std::thread([pid, script, start_ns] {
+        int status;
+        if (wait4_retry(pid, &status, 0, nullptr) == pid) {
+            LOGI("Script %s finished after %" PRId64 " ms", script.c_str(),
+                 (trace_now_ns() - start_ns) / 1000000);
+        }
+    }).detach();
+}
+
+}  // namespace ksud
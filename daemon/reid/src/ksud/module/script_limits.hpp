@@ -0,0 +1,54 @@
+#pragma once
+
+#include <sys/types.h>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+struct rusage;
+
+namespace ksud {
+
+enum class ScriptTimeoutAction {
+    Background,  // stop waiting, let the script finish on its own
+    Kill,        // kill the script's session
+};
+
+// Time limits for scripts of blocking boot stages, read once from SCRIPT_LIMITS_PATH
+// (key=value lines, times in seconds, 0 = no limit):
+//   script_timeout  one script
+//   stage_budget    all scripts of one stage together
+//   on_timeout      background | kill
+// init gives up on a blocking stage after about 10s, so the stage budget defaults to 8s: past it
+// the remaining scripts are left running instead of stalling metamount and the rest of boot.
+struct ScriptLimits {
+    int64_t script_timeout_ms = 0;
+    int64_t stage_budget_ms = 8000;
+    ScriptTimeoutAction on_timeout = ScriptTimeoutAction::Background;
+};
+
+const ScriptLimits& script_limits();
+
+// trace_now_ns() deadline of a script of `stage` started at start_ns, or INT64_MAX. The stage
+// budget starts counting at the first script of the stage.
+int64_t script_deadline_ns(const std::string& stage, int64_t start_ns);
+
+// True once the stage budget of `stage` has run out. Blocking stages then start their remaining
+// scripts like late_start ones: not waited for, so they do not each become an expired script.
+bool stage_budget_spent(const std::string& stage);
+
+// One summary line for the scripts a stage started after its budget was spent
+void log_late_scripts(const std::string& stage, size_t count);
+
+// pidfd for pid, or -1 on kernels without pidfd_open (before 5.3)
+int open_pidfd(pid_t pid);
+
+// Wait for pid until deadline_ns. Returns true with status and usage filled once the child was
+// reaped, false when the deadline passed first. Without pidfd support the wait is unbounded.
+bool wait_script_until(pid_t pid, int64_t deadline_ns, int* status, struct rusage* usage);
+
+// Handle a script that ran past its deadline according to on_timeout; the script is reaped by a
+// background thread and its total runtime logged
+void expire_script(pid_t pid, const std::string& script, int64_t start_ns);
+
+}  // namespace ksud
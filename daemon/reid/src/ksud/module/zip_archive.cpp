@@ -0,0 +1,670 @@
+#include "zip_archive.hpp"
+#include "../../log.hpp"
+#include "../../utils.hpp"
+
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <linux/fs.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <mutex>
+#include <thread>
+#include <unordered_set>
+
+#include "miniz.h"
+
+namespace ksud {
+
+static constexpr size_t ZIP_IO_BUF_SIZE = 64 * 1024;
+static constexpr uint32_t ZIP_LOCAL_HEADER_SIG = 0x04034b50;
+static constexpr size_t ZIP_LOCAL_HEADER_SIZE = 30;
+static constexpr uint16_t ZIP_METHOD_STORED = 0;
+static constexpr uint8_t ZIP_HOST_UNIX = 3;
+static constexpr size_t ZIP_KERNEL_COPY_CHUNK = 1 << 30;
+
+static uint16_t read_le16(const unsigned char* p) {
+    return static_cast<uint16_t>(p[0] | (p[1] << 8));
+}
+
+static uint32_t read_le32(const unsigned char* p) {
+    return static_cast<uint32_t>(p[0]) | (static_cast<uint32_t>(p[1]) << 8) |
+           (static_cast<uint32_t>(p[2]) << 16) | (static_cast<uint32_t>(p[3]) << 24);
+}
+
+// Read exactly len bytes at offset, retrying on short reads
+static bool pread_full(int fd, void* buf, size_t len, uint64_t offset) {
+    auto* p = static_cast<unsigned char*>(buf);
+    while (len > 0) {
+        ssize_t n = pread(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+static bool pwrite_full(int fd, const void* buf, size_t len, uint64_t offset) {
+    const auto* p = static_cast<const unsigned char*>(buf);
+    while (len > 0) {
+        ssize_t n = pwrite(fd, p, len, static_cast<off_t>(offset));
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            return false;
+        p += n;
+        len -= static_cast<size_t>(n);
+        offset += static_cast<uint64_t>(n);
+    }
+    return true;
+}
+
+// CRC32 of `len` bytes of fd starting at offset
+static bool crc32_range(int fd, uint64_t offset, uint64_t len, uint32_t* crc_out) {
+    std::vector<unsigned char> buf(ZIP_IO_BUF_SIZE);
+    mz_ulong crc = MZ_CRC32_INIT;
+    for (uint64_t done = 0; done < len;) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(len - done, buf.size()));
+        if (!pread_full(fd, buf.data(), chunk, offset + done))
+            return false;
+        crc = mz_crc32(crc, buf.data(), chunk);
+        done += chunk;
+    }
+    *crc_out = static_cast<uint32_t>(crc);
+    return true;
+}
+
+// miniz read callback; pread keeps it independent of the fd's file position
+static size_t zip_pread_func(void* opaque, mz_uint64 file_ofs, void* buf, size_t n) {
+    int fd = *static_cast<int*>(opaque);
+    return pread_full(fd, buf, n, file_ofs) ? n : 0;
+}
+
+bool zip_glob_match(const std::string& pattern, const std::string& name) {
+    return fnmatch(pattern.c_str(), name.c_str(), 0) == 0;
+}
+
+bool zip_entry_name_safe(const std::string& name) {
+    if (name.empty() || name[0] == '/')
+        return false;
+    for (const auto& part : split(name, '/')) {
+        if (part == "..")
+            return false;
+    }
+    return true;
+}
+
+static bool entry_selected(const std::string& name, const std::vector<std::string>& include,
+                           const std::vector<std::string>& exclude) {
+    for (const auto& pattern : exclude) {
+        if (zip_glob_match(pattern, name))
+            return false;
+    }
+    if (include.empty())
+        return true;
+    for (const auto& pattern : include) {
+        if (zip_glob_match(pattern, name))
+            return true;
+    }
+    return false;
+}
+
+ZipArchive::~ZipArchive() {
+    close();
+}
+
+bool ZipArchive::open(const std::string& path) {
+    close();
+
+    fd_ = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd_ < 0) {
+        LOGE("Failed to open zip %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd_, &st) != 0) {
+        LOGE("Failed to stat zip %s: %s", path.c_str(), strerror(errno));
+        close();
+        return false;
+    }
+    size_ = static_cast<uint64_t>(st.st_size);
+
+    // Let miniz parse the central directory once, then keep our own index
+    mz_zip_archive zip;
+    mz_zip_zero_struct(&zip);
+    zip.m_pRead = zip_pread_func;
+    zip.m_pIO_opaque = &fd_;
+    if (!mz_zip_reader_init(&zip, size_, 0)) {
+        LOGE("Failed to read zip %s: %s", path.c_str(),
+             mz_zip_get_error_string(mz_zip_get_last_error(&zip)));
+        close();
+        return false;
+    }
+
+    mz_uint count = mz_zip_reader_get_num_files(&zip);
+    entries_.reserve(count);
+    index_.reserve(count);
+    for (mz_uint i = 0; i < count; i++) {
+        mz_zip_archive_file_stat stat;
+        if (!mz_zip_reader_file_stat(&zip, i, &stat)) {
+            LOGW("Failed to stat zip entry %u in %s", i, path.c_str());
+            continue;
+        }
+        if (stat.m_is_encrypted) {
+            LOGW("Skipping encrypted zip entry %s", stat.m_filename);
+            continue;
+        }
+
+        ZipEntry entry;
+        entry.name = stat.m_filename;
+        entry.method = stat.m_method;
+        entry.crc32 = stat.m_crc32;
+        entry.comp_size = stat.m_comp_size;
+        entry.size = stat.m_uncomp_size;
+        entry.local_header_ofs = stat.m_local_header_ofs;
+        entry.is_dir = stat.m_is_directory;
+        if ((stat.m_version_made_by >> 8) == ZIP_HOST_UNIX) {
+            entry.mode = static_cast<mode_t>(stat.m_external_attr >> 16);
+        }
+
+        index_[entry.name] = entries_.size();
+        entries_.push_back(std::move(entry));
+    }
+    mz_zip_reader_end(&zip);
+
+    LOGD("Opened zip %s: %zu entries", path.c_str(), entries_.size());
+    return true;
+}
+
+void ZipArchive::close() {
+    if (fd_ >= 0) {
+        ::close(fd_);
+        fd_ = -1;
+    }
+    size_ = 0;
+    entries_.clear();
+    index_.clear();
+}
+
+const ZipEntry* ZipArchive::find(const std::string& name) const {
+    auto it = index_.find(name);
+    return it == index_.end() ? nullptr : &entries_[it->second];
+}
+
+std::optional<uint64_t> ZipArchive::data_offset(const ZipEntry& entry) const {
+    unsigned char header[ZIP_LOCAL_HEADER_SIZE];
+    if (!pread_full(fd_, header, sizeof(header), entry.local_header_ofs))
+        return std::nullopt;
+    if (read_le32(header) != ZIP_LOCAL_HEADER_SIG)
+        return std::nullopt;
+
+    // Name and extra field lengths of the local header may differ from the central directory
+    uint64_t offset = entry.local_header_ofs + ZIP_LOCAL_HEADER_SIZE + read_le16(header + 26) +
+                      read_le16(header + 28);
+    if (offset + entry.comp_size > size_)
+        return std::nullopt;
+    return offset;
+}
+
+bool ZipArchive::stream_entry(const ZipEntry& entry, const Sink& sink) const {
+    if (!is_open())
+        return false;
+
+    auto offset = data_offset(entry);
+    if (!offset) {
+        LOGE("Corrupt local header for zip entry %s", entry.name.c_str());
+        return false;
+    }
+
+    std::vector<unsigned char> in(ZIP_IO_BUF_SIZE);
+    uint64_t pos = *offset;
+    uint64_t remaining = entry.comp_size;
+    uint64_t total = 0;
+    mz_ulong crc = MZ_CRC32_INIT;
+
+    if (entry.method == ZIP_METHOD_STORED) {
+        while (remaining > 0) {
+            size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, in.size()));
+            if (!pread_full(fd_, in.data(), chunk, pos))
+                return false;
+            crc = mz_crc32(crc, in.data(), chunk);
+            if (!sink(in.data(), chunk))
+                return false;
+            pos += chunk;
+            remaining -= chunk;
+            total += chunk;
+        }
+    } else if (entry.method == MZ_DEFLATED) {
+        std::vector<unsigned char> out(ZIP_IO_BUF_SIZE);
+        mz_stream strm;
+        memset(&strm, 0, sizeof(strm));
+        if (mz_inflateInit2(&strm, -MZ_DEFAULT_WINDOW_BITS) != MZ_OK)
+            return false;
+
+        bool ok = false;
+        for (;;) {
+            if (strm.avail_in == 0 && remaining > 0) {
+                size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, in.size()));
+                if (!pread_full(fd_, in.data(), chunk, pos))
+                    break;
+                strm.next_in = in.data();
+                strm.avail_in = static_cast<unsigned int>(chunk);
+                pos += chunk;
+                remaining -= chunk;
+            }
+
+            unsigned int avail_in_before = strm.avail_in;
+            strm.next_out = out.data();
+            strm.avail_out = static_cast<unsigned int>(out.size());
+            int ret = mz_inflate(&strm, MZ_NO_FLUSH);
+
+            size_t produced = out.size() - strm.avail_out;
+            if (produced > 0) {
+                crc = mz_crc32(crc, out.data(), produced);
+                total += produced;
+                if (!sink(out.data(), produced))
+                    break;
+            }
+            if (ret == MZ_STREAM_END) {
+                ok = true;
+                break;
+            }
+            if (ret != MZ_OK && ret != MZ_BUF_ERROR)
+                break;
+            // No progress with nothing left to feed means the stream is truncated
+            if (produced == 0 && strm.avail_in == avail_in_before && remaining == 0)
+                break;
+        }
+        mz_inflateEnd(&strm);
+        if (!ok) {
+            LOGE("Failed to inflate zip entry %s", entry.name.c_str());
+            return false;
+        }
+    } else {
+        LOGE("Unsupported compression method %u for zip entry %s", entry.method,
+             entry.name.c_str());
+        return false;
+    }
+
+    if (total != entry.size || static_cast<uint32_t>(crc) != entry.crc32) {
+        LOGE("CRC/size mismatch for zip entry %s", entry.name.c_str());
+        return false;
+    }
+    return true;
+}
+
+std::optional<std::string> ZipArchive::read(const std::string& name) const {
+    const ZipEntry* entry = find(name);
+    if (!entry || entry->is_dir)
+        return std::nullopt;
+
+    std::string content;
+    content.reserve(static_cast<size_t>(entry->size));
+    bool ok = stream_entry(*entry, [&content](const void* data, size_t len) {
+        content.append(static_cast<const char*>(data), len);
+        return true;
+    });
+    if (!ok)
+        return std::nullopt;
+    return content;
+}
+
+// Move a STORED member straight from the archive fd to out_fd without a userspace copy.
+// copy_file_range is tried first (reflink/offload capable on the same filesystem), then
+// sendfile; Unsupported tells the caller to use the buffered read/write path instead.
+ZipArchive::KernelCopy ZipArchive::copy_stored_entry(const ZipEntry& entry, uint64_t offset,
+                                                     int out_fd) const {
+    loff_t in_off = static_cast<loff_t>(offset);
+    loff_t out_off = 0;
+    uint64_t remaining = entry.size;
+    bool use_copy_file_range = true;
+
+    while (remaining > 0) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(remaining, ZIP_KERNEL_COPY_CHUNK));
+        ssize_t n;
+        if (use_copy_file_range) {
+            n = syscall(__NR_copy_file_range, fd_, &in_off, out_fd, &out_off, chunk, 0);
+            if (n < 0 && (errno == EXDEV || errno == ENOSYS || errno == EINVAL ||
+                          errno == EOPNOTSUPP)) {
+                // sendfile writes at the file position, so continue from where we stopped
+                use_copy_file_range = false;
+                if (lseek(out_fd, out_off, SEEK_SET) < 0)
+                    return KernelCopy::Failed;
+                continue;
+            }
+        } else {
+            off_t sendfile_off = static_cast<off_t>(in_off);
+            n = sendfile(out_fd, fd_, &sendfile_off, chunk);
+            if (n < 0 && (errno == EINVAL || errno == ENOSYS))
+                return KernelCopy::Unsupported;
+            in_off = sendfile_off;
+            if (n > 0)
+                out_off += n;
+        }
+
+        if (n < 0 && errno == EINTR)
+            continue;
+        if (n <= 0) {
+            LOGE("Failed to copy zip entry %s: %s", entry.name.c_str(),
+                 n < 0 ? strerror(errno) : "unexpected end of archive");
+            return KernelCopy::Failed;
+        }
+        remaining -= static_cast<uint64_t>(n);
+    }
+    return KernelCopy::Done;
+}
+
+bool ZipArchive::extract_to_fd(const ZipEntry& entry, int out_fd) const {
+    if (entry.method == ZIP_METHOD_STORED && entry.size > 0 && entry.comp_size == entry.size) {
+        auto data = data_offset(entry);
+        if (!data) {
+            LOGE("Corrupt local header for zip entry %s", entry.name.c_str());
+            return false;
+        }
+        // The CRC needs every byte read once in userspace, so the kernel copy only saves the
+        // write-side copy and buffer; the check also pulls the member into the page cache the
+        // copy then reads from. Checked first, so only verified bytes are ever written.
+        uint32_t crc;
+        if (!crc32_range(fd_, *data, entry.size, &crc))
+            return false;
+        if (crc != entry.crc32) {
+            LOGE("CRC/size mismatch for zip entry %s", entry.name.c_str());
+            return false;
+        }
+        switch (copy_stored_entry(entry, *data, out_fd)) {
+        case KernelCopy::Done:
+            return true;
+        case KernelCopy::Failed:
+            return false;
+        case KernelCopy::Unsupported:
+            break;
+        }
+    }
+
+    uint64_t offset = 0;
+    return stream_entry(entry, [out_fd, &offset](const void* data, size_t len) {
+        if (!pwrite_full(out_fd, data, len, offset))
+            return false;
+        offset += len;
+        return true;
+    });
+}
+
+// Take over an unchanged file from a previous extraction. The old copy is only read (to check
+// its CRC32 and to copy it), never written: a reflink is tried first, then a hard link if
+// `can_share_inode` allows it for this file, and a plain copy otherwise (before_copy runs first).
+static bool reuse_entry_file(const ZipEntry& entry, const std::string& rel,
+                             const std::string& old_path, const std::string& path,
+                             const ZipExtractOptions& options,
+                             const std::function<void()>& before_copy) {
+    int src = open(old_path.c_str(), O_RDONLY | O_NOFOLLOW | O_CLOEXEC);
+    if (src < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(src, &st) != 0 || !S_ISREG(st.st_mode) ||
+        static_cast<uint64_t>(st.st_size) != entry.size) {
+        close(src);
+        return false;
+    }
+
+    uint32_t crc;
+    if (!crc32_range(src, 0, entry.size, &crc) || crc != entry.crc32) {
+        close(src);
+        return false;
+    }
+
+    unlink(path.c_str());
+    int dst = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, st.st_mode & 07777);
+    if (dst < 0) {
+        close(src);
+        return false;
+    }
+    if (ioctl(dst, FICLONE, src) == 0) {
+        close(dst);
+        close(src);
+        return true;
+    }
+
+    // A hard link would let later chmod/chown/relabel or in-place writes on the staged tree
+    // change the installed file too, so it is only used where the caller rules that out
+    if (options.can_share_inode && options.can_share_inode(rel, st)) {
+        close(dst);
+        unlink(path.c_str());
+        bool linked = link(old_path.c_str(), path.c_str()) == 0;
+        close(src);
+        return linked;
+    }
+
+    before_copy();
+    std::vector<unsigned char> buf(ZIP_IO_BUF_SIZE);
+    bool ok = true;
+    for (uint64_t offset = 0; ok && offset < entry.size;) {
+        size_t chunk = static_cast<size_t>(std::min<uint64_t>(entry.size - offset, buf.size()));
+        ok = pread_full(src, buf.data(), chunk, offset) &&
+             pwrite_full(dst, buf.data(), chunk, offset);
+        offset += chunk;
+    }
+    close(dst);
+    close(src);
+    if (!ok)
+        unlink(path.c_str());
+    return ok;
+}
+
+// Create and fill one regular file; space is reserved up front so the writes never extend it
+static bool write_entry_file(const ZipArchive& zip, const ZipEntry& entry,
+                             const std::string& path) {
+    // Overwrite like unzip -o, never following a symlink left at the destination
+    unlink(path.c_str());
+
+    mode_t perm = (entry.mode & 07777) ? (entry.mode & 07777) : 0644;
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, perm);
+    if (fd < 0) {
+        LOGE("Failed to create %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    if (entry.size > 0 && fallocate(fd, 0, 0, static_cast<off_t>(entry.size)) != 0 &&
+        errno != EOPNOTSUPP && errno != ENOSYS) {
+        LOGE("Failed to reserve %llu bytes for %s: %s",
+             static_cast<unsigned long long>(entry.size), path.c_str(), strerror(errno));
+        close(fd);
+        return false;
+    }
+    bool ok = zip.extract_to_fd(entry, fd);
+    close(fd);
+    if (!ok) {
+        LOGE("Failed to extract %s", entry.name.c_str());
+    }
+    return ok;
+}
+
+bool ZipArchive::extract(const std::string& dest_dir, const ZipExtractOptions& options,
+                         ZipExtractStats* stats) const {
+    if (!is_open())
+        return false;
+    if (!ensure_dir_exists(dest_dir))
+        return false;
+
+    // Directories already known to exist, so each one is created at most once
+    std::unordered_set<std::string> made_dirs;
+    auto make_dir = [&made_dirs](const std::string& dir) {
+        if (made_dirs.count(dir))
+            return true;
+        if (!ensure_dir_exists(dir))
+            return false;
+        made_dirs.insert(dir);
+        return true;
+    };
+
+    struct Job {
+        const ZipEntry* entry;
+        std::string rel;
+        std::string path;
+    };
+    std::vector<Job> members;
+    size_t dirs = 0;
+
+    // Pass 1: select members and create the whole directory skeleton serially
+    for (const auto& entry : entries_) {
+        if (!entry_selected(entry.name, options.include, options.exclude))
+            continue;
+        if (!zip_entry_name_safe(entry.name)) {
+            LOGW("Skipping unsafe zip entry: %s", entry.name.c_str());
+            continue;
+        }
+
+        std::string rel = entry.name;
+        while (!rel.empty() && rel.back() == '/')
+            rel.pop_back();
+        if (rel.empty())
+            continue;
+        std::string path = dest_dir + "/" + rel;
+
+        if (entry.is_dir) {
+            if (!make_dir(path))
+                return false;
+            dirs++;
+            continue;
+        }
+        if (!make_dir(path.substr(0, path.find_last_of('/'))))
+            return false;
+
+        members.push_back({&entry, std::move(rel), std::move(path)});
+    }
+
+    // A name listed twice would have two workers writing the same path; like unzip -o, the
+    // last entry wins
+    std::vector<Job> files;
+    std::vector<Job> links;
+    std::unordered_set<std::string> seen;
+    for (auto it = members.rbegin(); it != members.rend(); ++it) {
+        if (!seen.insert(it->rel).second) {
+            LOGW("Duplicate zip entry %s, keeping the last one", it->entry->name.c_str());
+            continue;
+        }
+        (S_ISLNK(it->entry->mode) ? links : files).push_back(std::move(*it));
+    }
+    std::reverse(links.begin(), links.end());
+
+    // Pass 2: inflate regular files on a bounded pool. Largest members go first so one big
+    // asset does not end up as the tail of a single worker.
+    std::sort(files.begin(), files.end(),
+              [](const Job& a, const Job& b) { return a.entry->size > b.entry->size; });
+
+    unsigned jobs = options.jobs;
+    if (jobs == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        jobs = cpus > 0 ? static_cast<unsigned>(cpus) : 1;
+    }
+    jobs = std::max(1u, std::min<unsigned>(jobs, static_cast<unsigned>(files.size())));
+
+    std::atomic<size_t> next{0};
+    std::atomic<bool> failed{false};
+    std::atomic<size_t> reused{0};
+    std::atomic<uint64_t> reused_bytes{0};
+
+    // Hand a member's share of the caller's reservation back right before it is written
+    std::mutex reserve_mutex;
+    uint64_t reserve_left = 0;
+    blksize_t reserve_block = 4096;
+    struct stat reserve_st;
+    if (options.reserve_fd >= 0 && fstat(options.reserve_fd, &reserve_st) == 0) {
+        reserve_left = static_cast<uint64_t>(reserve_st.st_size);
+        if (reserve_st.st_blksize > 0)
+            reserve_block = reserve_st.st_blksize;
+    }
+    auto release_reserved = [&](uint64_t size) {
+        if (reserve_left == 0)
+            return;
+        uint64_t block = static_cast<uint64_t>(reserve_block);
+        uint64_t need = (size + block - 1) / block * block;
+        std::lock_guard<std::mutex> lock(reserve_mutex);
+        reserve_left -= std::min(reserve_left, need);
+        if (ftruncate(options.reserve_fd, static_cast<off_t>(reserve_left)) != 0)
+            LOGW("Failed to shrink install reservation: %s", strerror(errno));
+    };
+
+    auto worker = [&]() {
+        for (;;) {
+            if (failed.load(std::memory_order_relaxed))
+                return;
+            size_t i = next.fetch_add(1, std::memory_order_relaxed);
+            if (i >= files.size())
+                return;
+            const Job& job = files[i];
+            auto release = [&] { release_reserved(job.entry->size); };
+            if (!options.reuse_dir.empty() &&
+                reuse_entry_file(*job.entry, job.rel, options.reuse_dir + "/" + job.rel, job.path,
+                                 options, release)) {
+                reused.fetch_add(1, std::memory_order_relaxed);
+                reused_bytes.fetch_add(job.entry->size, std::memory_order_relaxed);
+                continue;
+            }
+            release();
+            if (!write_entry_file(*this, *job.entry, job.path)) {
+                failed.store(true, std::memory_order_relaxed);
+                return;
+            }
+        }
+    };
+
+    if (jobs == 1) {
+        worker();
+    } else {
+        LOGD("Extracting %zu files with %u workers", files.size(), jobs);
+        std::vector<std::thread> pool;
+        pool.reserve(jobs);
+        for (unsigned i = 0; i < jobs; i++) {
+            pool.emplace_back(worker);
+        }
+        for (auto& t : pool) {
+            t.join();
+        }
+    }
+    if (failed.load())
+        return false;
+
+    // Pass 3: symlinks last, once every regular file is in place
+    for (const auto& link : links) {
+        std::string target;
+        if (!stream_entry(*link.entry, [&target](const void* data, size_t len) {
+                target.append(static_cast<const char*>(data), len);
+                return true;
+            })) {
+            return false;
+        }
+        unlink(link.path.c_str());
+        if (symlink(target.c_str(), link.path.c_str()) != 0) {
+            LOGE("Failed to create symlink %s: %s", link.path.c_str(), strerror(errno));
+            return false;
+        }
+    }
+
+    if (stats) {
+        stats->dirs += dirs;
+        stats->files += files.size() + links.size();
+        for (const auto& job : files) {
+            stats->bytes += job.entry->size;
+        }
+        for (const auto& job : links) {
+            stats->bytes += job.entry->size;
+        }
+        stats->reused += reused.load();
+        stats->reused_bytes += reused_bytes.load();
+    }
+    return true;
+}
+
+}  // namespace ksud
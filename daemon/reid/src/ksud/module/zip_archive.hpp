@@ -0,0 +1,107 @@
+#pragma once
+
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <cstdint>
+#include <functional>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace ksud {
+
+// One member of the central directory
+struct ZipEntry {
+    std::string name;
+    uint16_t method = 0;
+    uint32_t crc32 = 0;
+    uint64_t comp_size = 0;
+    uint64_t size = 0;
+    uint64_t local_header_ofs = 0;
+    mode_t mode = 0;  // Unix st_mode from the external attributes, 0 if not recorded
+    bool is_dir = false;
+};
+
+struct ZipExtractOptions {
+    // Members matching any include glob (all when empty) and no exclude glob are extracted.
+    // Globs follow unzip semantics: '*' also matches across '/', e.g. "META-INF/*".
+    std::vector<std::string> include;
+    std::vector<std::string> exclude;
+    // Worker threads inflating members in parallel, 0 = number of online CPUs
+    unsigned jobs = 1;
+    // Tree of a previous extraction (e.g. the installed module). Regular files there whose size
+    // and CRC32 match the central directory are reflinked or copied instead of inflated.
+    std::string reuse_dir;
+    // Without reflink support, a reused file may be hard-linked instead of copied only if this
+    // returns true for it (member name without trailing '/', stat of the old file). The link
+    // shares the inode with reuse_dir, so nothing may change the new file's data or attributes.
+    std::function<bool(const std::string& rel, const struct stat& st)> can_share_inode;
+    // Preallocated file holding space claimed for this extraction. It is shrunk by each member's
+    // size (rounded up to whole blocks) right before the member is written, so the space stays
+    // claimed until it is actually used. -1 for none.
+    int reserve_fd = -1;
+};
+
+struct ZipExtractStats {
+    size_t files = 0;
+    size_t dirs = 0;
+    uint64_t bytes = 0;
+    size_t reused = 0;  // files taken over from ZipExtractOptions::reuse_dir
+    uint64_t reused_bytes = 0;
+};
+
+// In-process ZIP reader backed by miniz.
+// The archive is opened once and its central directory is indexed in memory, so members can be
+// looked up by name, read into memory or streamed to disk without spawning unzip.
+class ZipArchive {
+public:
+    ZipArchive() = default;
+    ~ZipArchive();
+    ZipArchive(const ZipArchive&) = delete;
+    ZipArchive& operator=(const ZipArchive&) = delete;
+
+    bool open(const std::string& path);
+    void close();
+    bool is_open() const { return fd_ >= 0; }
+
+    const std::vector<ZipEntry>& entries() const { return entries_; }
+    const ZipEntry* find(const std::string& name) const;
+
+    // Read a single member into memory, nullopt if missing or corrupt
+    std::optional<std::string> read(const std::string& name) const;
+
+    // Extract the selected members below dest_dir. Directories are created up front, regular
+    // files are spread over a bounded worker pool and symlinks are created after it joins, so
+    // the resulting tree does not depend on the number of jobs.
+    bool extract(const std::string& dest_dir, const ZipExtractOptions& options = {},
+                 ZipExtractStats* stats = nullptr) const;
+
+    // Stream one member into an open file descriptor from offset 0, verifying its CRC32.
+    // STORED members are CRC-checked in the archive (one userspace read), then moved in-kernel
+    // with copy_file_range/sendfile when possible, which saves the buffered write. Safe to call
+    // concurrently for different entries.
+    bool extract_to_fd(const ZipEntry& entry, int out_fd) const;
+
+private:
+    using Sink = std::function<bool(const void* data, size_t len)>;
+
+    enum class KernelCopy { Done, Unsupported, Failed };
+
+    bool stream_entry(const ZipEntry& entry, const Sink& sink) const;
+    KernelCopy copy_stored_entry(const ZipEntry& entry, uint64_t offset, int out_fd) const;
+    std::optional<uint64_t> data_offset(const ZipEntry& entry) const;
+
+    int fd_ = -1;
+    uint64_t size_ = 0;
+    std::vector<ZipEntry> entries_;
+    std::unordered_map<std::string, size_t> index_;
+};
+
+// unzip-style glob match ('*' and '?' also match '/')
+bool zip_glob_match(const std::string& pattern, const std::string& name);
+
+// Reject absolute names and ".." components that would escape the destination
+bool zip_entry_name_safe(const std::string& name);
+
+}  // namespace ksud
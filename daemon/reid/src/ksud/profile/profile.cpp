@@ -2,9 +2,11 @@
 #include "../../defs.hpp"
 #include "../../log.hpp"
 #include "../../utils.hpp"
+#include "../sepolicy/sepolicy.hpp"
 
 #include <dirent.h>
 #include <unistd.h>
+#include <algorithm>
 #include <fstream>
 
 namespace ksud {
@@ -82,11 +84,12 @@ int profile_list_templates() {
     return 0;
 }
 
-int apply_profile_sepolies() {
+void collect_profile_sepolies(std::vector<SepolicySource>& out) {
     DIR* dir = opendir(PROFILE_SELINUX_DIR);
     if (!dir)
-        return 0;
+        return;
 
+    size_t first = out.size();
     struct dirent* entry;
     while ((entry = readdir(dir)) != nullptr) {
         if (entry->d_name[0] == '.')
@@ -97,12 +100,15 @@ int apply_profile_sepolies() {
         if (!content)
             continue;
 
-        // TODO: Apply sepolicy via ksucalls
-        LOGD("Apply sepolicy for %s", entry->d_name);
+        LOGD("Collect sepolicy for %s", entry->d_name);
+        out.push_back({std::string("profile:") + entry->d_name, std::move(*content)});
     }
 
     closedir(dir);
-    return 0;
+
+    // readdir order is arbitrary; keep the set stable so its compiled form stays cached
+    std::sort(out.begin() + static_cast<std::ptrdiff_t>(first), out.end(),
+              [](const SepolicySource& a, const SepolicySource& b) { return a.name < b.name; });
 }
 
 }  // namespace ksud
@@ -1,14 +1,25 @@
 #include "sepolicy.hpp"
 #include "../ksucalls.hpp"
+#include "../../defs.hpp"
 #include "../../log.hpp"
 #include "../../utils.hpp"
 
+#include "picosha2.h"
+
 #include <sys/stat.h>
+#include <unistd.h>
 #include <algorithm>
 #include <cctype>
+#include <cerrno>
+#include <cstdio>
 #include <cstring>
+#include <deque>
 #include <fstream>
+#include <functional>
+#include <iterator>
 #include <sstream>
+#include <string_view>
+#include <unordered_map>
 #include <vector>
 
 namespace ksud {
@@ -58,71 +69,72 @@ struct FfiPolicy {
     const char* sepol7;
 };
 
-// PolicyObject - holds a sepolicy string or represents "all" (*)
-class PolicyObject {
-public:
-    enum Type { NONE, ALL, ONE };
-
-    PolicyObject() : type_(NONE) { memset(buf_, 0, sizeof(buf_)); }
+// Interned sepolicy identifiers. A statement refers to its objects by 4-byte handles into a
+// SymbolTable, so expanded statements stay small and every name is stored once.
+using Sym = uint32_t;
+static constexpr Sym SYM_NONE = 0;  // field not used
+static constexpr Sym SYM_ALL = 1;   // "*"
 
-    static PolicyObject none() { return PolicyObject(); }
-
-    static PolicyObject all() {
-        PolicyObject obj;
-        obj.type_ = ALL;
-        return obj;
+class SymbolTable {
+public:
+    SymbolTable() : strings_(2) {}
+    SymbolTable(const SymbolTable&) = delete;
+    SymbolTable& operator=(const SymbolTable&) = delete;
+
+    Sym intern(const std::string& s) {
+        if (s == "*")
+            return SYM_ALL;
+        if (s.length() >= SEPOLICY_MAX_LEN)
+            return SYM_NONE;
+        auto it = index_.find(s);
+        if (it != index_.end())
+            return it->second;
+        Sym sym = static_cast<Sym>(strings_.size());
+        strings_.push_back(s);
+        // deque elements never move, so the view stays valid
+        index_.emplace(strings_.back(), sym);
+        return sym;
     }
 
-    static PolicyObject from_str(const std::string& s) {
-        PolicyObject obj;
-        if (s == "*") {
-            obj.type_ = ALL;
-        } else if (s.length() < SEPOLICY_MAX_LEN) {
-            obj.type_ = ONE;
-            strncpy(obj.buf_, s.c_str(), SEPOLICY_MAX_LEN - 1);
-            obj.buf_[SEPOLICY_MAX_LEN - 1] = '\0';
-        }
-        return obj;
-    }
+    // NULL for SYM_NONE and SYM_ALL, which the kernel treats as "none" and "all"
+    const char* c_ptr(Sym sym) const { return sym > SYM_ALL ? strings_[sym].c_str() : nullptr; }
 
-    const char* c_ptr() const {
-        if (type_ == ONE) {
-            return buf_;
-        }
-        return nullptr;  // NULL for NONE and ALL
+    size_t size() const { return strings_.size(); }
+    void clear() {
+        index_.clear();
+        strings_.resize(2);
     }
-
-    Type type() const { return type_; }
+    const std::string& str(Sym sym) const { return strings_[sym]; }
 
 private:
-    Type type_;
-    char buf_[SEPOLICY_MAX_LEN];
+    std::deque<std::string> strings_;
+    std::unordered_map<std::string_view, Sym> index_;
 };
 
 // AtomicStatement - a single sepolicy operation to send to kernel
 struct AtomicStatement {
-    uint32_t cmd;
-    uint32_t subcmd;
-    PolicyObject sepol1;
-    PolicyObject sepol2;
-    PolicyObject sepol3;
-    PolicyObject sepol4;
-    PolicyObject sepol5;
-    PolicyObject sepol6;
-    PolicyObject sepol7;
-
-    FfiPolicy to_ffi() const {
+    uint32_t cmd = 0;
+    uint32_t subcmd = 0;
+    Sym sepol[7] = {};
+
+    FfiPolicy to_ffi(const SymbolTable& syms) const {
         return FfiPolicy{cmd,
                          subcmd,
-                         sepol1.c_ptr(),
-                         sepol2.c_ptr(),
-                         sepol3.c_ptr(),
-                         sepol4.c_ptr(),
-                         sepol5.c_ptr(),
-                         sepol6.c_ptr(),
-                         sepol7.c_ptr()};
+                         syms.c_ptr(sepol[0]),
+                         syms.c_ptr(sepol[1]),
+                         syms.c_ptr(sepol[2]),
+                         syms.c_ptr(sepol[3]),
+                         syms.c_ptr(sepol[4]),
+                         syms.c_ptr(sepol[5]),
+                         syms.c_ptr(sepol[6])};
     }
 };
+// Cached compiled sets store statements as raw bytes
+static_assert(sizeof(AtomicStatement) == 36, "AtomicStatement must stay compact and unpadded");
+
+// Receives expanded statements one at a time, so a rule's cartesian product is never
+// materialized
+using StatementSink = std::function<void(const AtomicStatement&)>;
 
 // Helper: check if char is valid in sepolicy identifier
 static bool is_sepolicy_char(char c) {
@@ -182,8 +194,16 @@ static const char* parse_seobj(const char* p, std::vector<std::string>& out) {
     return p;
 }
 
-// Parse and expand a single rule into AtomicStatements
-static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& statements) {
+static std::vector<Sym> intern_all(SymbolTable& syms, const std::vector<std::string>& words) {
+    std::vector<Sym> out;
+    out.reserve(words.size());
+    for (const auto& w : words)
+        out.push_back(syms.intern(w));
+    return out;
+}
+
+// Parse a single rule and stream its expansion into AtomicStatements
+static bool parse_rule(const std::string& rule, SymbolTable& syms, const StatementSink& emit) {
     const char* p = rule.c_str();
     p = skip_space(p);
 
@@ -234,18 +254,21 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         p = parse_seobj(p, perms);
 
         // Expand to atomic statements
+        AtomicStatement stmt;
+        stmt.cmd = CMD_NORMAL_PERM;
+        stmt.subcmd = subcmd;
+        std::vector<Sym> t_syms = intern_all(syms, targets);
+        std::vector<Sym> c_syms = intern_all(syms, classes);
+        std::vector<Sym> p_syms = intern_all(syms, perms);
         for (const auto& s : sources) {
-            for (const auto& t : targets) {
-                for (const auto& c : classes) {
-                    for (const auto& perm : perms) {
-                        AtomicStatement stmt;
-                        stmt.cmd = CMD_NORMAL_PERM;
-                        stmt.subcmd = subcmd;
-                        stmt.sepol1 = PolicyObject::from_str(s);
-                        stmt.sepol2 = PolicyObject::from_str(t);
-                        stmt.sepol3 = PolicyObject::from_str(c);
-                        stmt.sepol4 = PolicyObject::from_str(perm);
-                        statements.push_back(stmt);
+            stmt.sepol[0] = syms.intern(s);
+            for (Sym t : t_syms) {
+                stmt.sepol[1] = t;
+                for (Sym c : c_syms) {
+                    stmt.sepol[2] = c;
+                    for (Sym perm : p_syms) {
+                        stmt.sepol[3] = perm;
+                        emit(stmt);
                     }
                 }
             }
@@ -300,18 +323,20 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
             p = parse_word(p, perm_set);
         }
 
+        AtomicStatement stmt;
+        stmt.cmd = CMD_XPERM;
+        stmt.subcmd = subcmd;
+        stmt.sepol[3] = syms.intern(operation);
+        stmt.sepol[4] = syms.intern(perm_set);
+        std::vector<Sym> t_syms = intern_all(syms, targets);
+        std::vector<Sym> c_syms = intern_all(syms, classes);
         for (const auto& s : sources) {
-            for (const auto& t : targets) {
-                for (const auto& c : classes) {
-                    AtomicStatement stmt;
-                    stmt.cmd = CMD_XPERM;
-                    stmt.subcmd = subcmd;
-                    stmt.sepol1 = PolicyObject::from_str(s);
-                    stmt.sepol2 = PolicyObject::from_str(t);
-                    stmt.sepol3 = PolicyObject::from_str(c);
-                    stmt.sepol4 = PolicyObject::from_str(operation);
-                    stmt.sepol5 = PolicyObject::from_str(perm_set);
-                    statements.push_back(stmt);
+            stmt.sepol[0] = syms.intern(s);
+            for (Sym t : t_syms) {
+                stmt.sepol[1] = t;
+                for (Sym c : c_syms) {
+                    stmt.sepol[2] = c;
+                    emit(stmt);
                 }
             }
         }
@@ -329,8 +354,8 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
             AtomicStatement stmt;
             stmt.cmd = CMD_TYPE_STATE;
             stmt.subcmd = subcmd;
-            stmt.sepol1 = PolicyObject::from_str(t);
-            statements.push_back(stmt);
+            stmt.sepol[0] = syms.intern(t);
+            emit(stmt);
         }
         return true;
     }
@@ -349,16 +374,16 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
             AtomicStatement stmt;
             stmt.cmd = CMD_TYPE;
             stmt.subcmd = 0;
-            stmt.sepol1 = PolicyObject::from_str(type_name);
-            statements.push_back(stmt);
+            stmt.sepol[0] = syms.intern(type_name);
+            emit(stmt);
         } else {
             for (const auto& attr : attrs) {
                 AtomicStatement stmt;
                 stmt.cmd = CMD_TYPE;
                 stmt.subcmd = 0;
-                stmt.sepol1 = PolicyObject::from_str(type_name);
-                stmt.sepol2 = PolicyObject::from_str(attr);
-                statements.push_back(stmt);
+                stmt.sepol[0] = syms.intern(type_name);
+                stmt.sepol[1] = syms.intern(attr);
+                emit(stmt);
             }
         }
         return true;
@@ -370,14 +395,15 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         p = parse_seobj(p, types);
         p = parse_seobj(p, attrs);
 
+        AtomicStatement stmt;
+        stmt.cmd = CMD_TYPE_ATTR;
+        stmt.subcmd = 0;
+        std::vector<Sym> attr_syms = intern_all(syms, attrs);
         for (const auto& t : types) {
-            for (const auto& attr : attrs) {
-                AtomicStatement stmt;
-                stmt.cmd = CMD_TYPE_ATTR;
-                stmt.subcmd = 0;
-                stmt.sepol1 = PolicyObject::from_str(t);
-                stmt.sepol2 = PolicyObject::from_str(attr);
-                statements.push_back(stmt);
+            stmt.sepol[0] = syms.intern(t);
+            for (Sym attr : attr_syms) {
+                stmt.sepol[1] = attr;
+                emit(stmt);
             }
         }
         return true;
@@ -392,8 +418,8 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         AtomicStatement stmt;
         stmt.cmd = CMD_ATTR;
         stmt.subcmd = 0;
-        stmt.sepol1 = PolicyObject::from_str(attr_name);
-        statements.push_back(stmt);
+        stmt.sepol[0] = syms.intern(attr_name);
+        emit(stmt);
         return true;
     }
 
@@ -442,14 +468,14 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         AtomicStatement stmt;
         stmt.cmd = CMD_TYPE_TRANSITION;
         stmt.subcmd = 0;
-        stmt.sepol1 = PolicyObject::from_str(source);
-        stmt.sepol2 = PolicyObject::from_str(target);
-        stmt.sepol3 = PolicyObject::from_str(tclass);
-        stmt.sepol4 = PolicyObject::from_str(default_type);
+        stmt.sepol[0] = syms.intern(source);
+        stmt.sepol[1] = syms.intern(target);
+        stmt.sepol[2] = syms.intern(tclass);
+        stmt.sepol[3] = syms.intern(default_type);
         if (!object_name.empty()) {
-            stmt.sepol5 = PolicyObject::from_str(object_name);
+            stmt.sepol[4] = syms.intern(object_name);
         }
-        statements.push_back(stmt);
+        emit(stmt);
         return true;
     }
 
@@ -484,11 +510,11 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         AtomicStatement stmt;
         stmt.cmd = CMD_TYPE_CHANGE;
         stmt.subcmd = subcmd;
-        stmt.sepol1 = PolicyObject::from_str(source);
-        stmt.sepol2 = PolicyObject::from_str(target);
-        stmt.sepol3 = PolicyObject::from_str(tclass);
-        stmt.sepol4 = PolicyObject::from_str(default_type);
-        statements.push_back(stmt);
+        stmt.sepol[0] = syms.intern(source);
+        stmt.sepol[1] = syms.intern(target);
+        stmt.sepol[2] = syms.intern(tclass);
+        stmt.sepol[3] = syms.intern(default_type);
+        emit(stmt);
         return true;
     }
 
@@ -518,10 +544,10 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
         AtomicStatement stmt;
         stmt.cmd = CMD_GENFSCON;
         stmt.subcmd = 0;
-        stmt.sepol1 = PolicyObject::from_str(fs_name);
-        stmt.sepol2 = PolicyObject::from_str(partial_path);
-        stmt.sepol3 = PolicyObject::from_str(fs_context);
-        statements.push_back(stmt);
+        stmt.sepol[0] = syms.intern(fs_name);
+        stmt.sepol[1] = syms.intern(partial_path);
+        stmt.sepol[2] = syms.intern(fs_context);
+        emit(stmt);
         return true;
     }
 
@@ -530,8 +556,8 @@ static bool parse_rule(const std::string& rule, std::vector<AtomicStatement>& st
 }
 
 // Apply a single atomic statement to kernel
-static int apply_statement(const AtomicStatement& stmt) {
-    FfiPolicy ffi = stmt.to_ffi();
+static int apply_statement(const AtomicStatement& stmt, const SymbolTable& syms) {
+    FfiPolicy ffi = stmt.to_ffi(syms);
 
     SetSepolicyCmd cmd;
     cmd.cmd = 0;
@@ -544,11 +570,10 @@ static int apply_statement(const AtomicStatement& stmt) {
     return ret;
 }
 
-int sepolicy_live_patch(const std::string& policy) {
-    std::vector<AtomicStatement> statements;
+// Split policy text into rules (by newline and semicolon) and stream their statements.
+// Returns the number of rules that failed to parse.
+static int parse_policy(const std::string& policy, SymbolTable& syms, const StatementSink& emit) {
     int errors = 0;
-
-    // Split by newline and semicolon
     std::istringstream iss(policy);
     std::string line;
 
@@ -562,22 +587,231 @@ int sepolicy_live_patch(const std::string& policy) {
                 continue;
             }
 
-            std::vector<AtomicStatement> rule_stmts;
-            if (!parse_rule(trimmed, rule_stmts)) {
+            if (!parse_rule(trimmed, syms, emit)) {
                 LOGW("Failed to parse rule: %s", trimmed.c_str());
                 errors++;
-                continue;
             }
+        }
+    }
+    return errors;
+}
 
-            for (const auto& stmt : rule_stmts) {
-                if (apply_statement(stmt) < 0) {
-                    errors++;
-                }
+int sepolicy_live_patch(const std::string& policy) {
+    SymbolTable syms;
+    int errors = 0;
+    errors += parse_policy(policy, syms, [&](const AtomicStatement& stmt) {
+        if (apply_statement(stmt, syms) < 0) {
+            errors++;
+        }
+    });
+
+    return errors > 0 ? 1 : 0;
+}
+
+int sepolicy_live_patch_batch(const std::vector<std::string>& rules) {
+    // One symbol table for the whole batch; names repeat across rules
+    SymbolTable syms;
+    int ok_count = 0;
+    for (const auto& rule : rules) {
+        int errors = 0;
+        errors += parse_policy(rule, syms, [&](const AtomicStatement& stmt) {
+            if (apply_statement(stmt, syms) < 0) {
+                errors++;
             }
+        });
+        if (errors == 0) {
+            ok_count++;
         }
     }
+    return ok_count;
+}
 
-    return errors > 0 ? 1 : 0;
+// Compiled patch sets
+
+static constexpr uint32_t CACHE_MAGIC = 0x31505352;  // "RSP1"
+static constexpr uint32_t CACHE_VERSION = 2;
+
+static void put_u32(std::string& out, uint32_t v) {
+    out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+// Byte key of a statement. With slot set, the key leaves out the part a later statement of the
+// same kind overwrites (allow vs deny, permissive vs enforce, the default type of a
+// transition), so two statements share a slot when the second one replaces the first.
+static std::string statement_key(const AtomicStatement& stmt, bool slot) {
+    AtomicStatement key = stmt;
+    if (slot) {
+        if (key.cmd == CMD_NORMAL_PERM && key.subcmd == SUBCMD_DENY)
+            key.subcmd = SUBCMD_ALLOW;
+        else if (key.cmd == CMD_TYPE_STATE)
+            key.subcmd = 0;
+        else if (key.cmd == CMD_TYPE_TRANSITION || key.cmd == CMD_TYPE_CHANGE)
+            key.sepol[3] = SYM_NONE;
+        else if (key.cmd == CMD_GENFSCON)
+            key.sepol[2] = SYM_NONE;
+    }
+    return std::string(reinterpret_cast<const char*>(&key), sizeof(key));
+}
+
+static bool has_wildcard(const AtomicStatement& stmt) {
+    return std::find(std::begin(stmt.sepol), std::end(stmt.sepol), SYM_ALL) !=
+           std::end(stmt.sepol);
+}
+
+// Drop statements that would leave the policy unchanged because the latest statement for the
+// same slot was identical. Wildcard statements may touch any slot of their command, so they are
+// always kept and forget what is known about that command. Returns the number dropped.
+static size_t dedupe_statements(std::vector<AtomicStatement>& statements) {
+    std::unordered_map<std::string, std::string> latest;  // slot key -> full key
+    std::vector<AtomicStatement> out;
+    out.reserve(statements.size());
+
+    for (const auto& stmt : statements) {
+        if (has_wildcard(stmt)) {
+            for (auto it = latest.begin(); it != latest.end();) {
+                uint32_t cmd;
+                memcpy(&cmd, it->first.data(), sizeof(cmd));
+                it = cmd == stmt.cmd ? latest.erase(it) : std::next(it);
+            }
+            out.push_back(stmt);
+            continue;
+        }
+
+        std::string full = statement_key(stmt, false);
+        std::string& last = latest[statement_key(stmt, true)];
+        if (last == full)
+            continue;
+        last = std::move(full);
+        out.push_back(stmt);
+    }
+
+    size_t removed = statements.size() - out.size();
+    statements.swap(out);
+    return removed;
+}
+
+static std::string sources_digest(const std::vector<SepolicySource>& sources) {
+    std::string input;
+    put_u32(input, CACHE_VERSION);
+    for (const auto& src : sources) {
+        put_u32(input, static_cast<uint32_t>(src.name.size()));
+        input += src.name;
+        put_u32(input, static_cast<uint32_t>(src.rules.size()));
+        input += src.rules;
+    }
+    std::string digest(picosha2::k_digest_size, '\0');
+    picosha2::hash256(input.begin(), input.end(), digest.begin(), digest.end());
+    return digest;
+}
+
+// Cache layout: magic, version, digest, parse error count, the interned names (handles from 2
+// up, length-prefixed), then the statements as raw cmd, subcmd and seven handles
+static std::string serialize_compiled(const std::string& digest, uint32_t errors,
+                                      const SymbolTable& syms,
+                                      const std::vector<AtomicStatement>& statements) {
+    std::string out;
+    put_u32(out, CACHE_MAGIC);
+    put_u32(out, CACHE_VERSION);
+    out += digest;
+    put_u32(out, errors);
+    put_u32(out, static_cast<uint32_t>(syms.size()));
+    for (Sym sym = SYM_ALL + 1; sym < syms.size(); sym++) {
+        put_u32(out, static_cast<uint32_t>(syms.str(sym).size()));
+        out += syms.str(sym);
+    }
+    put_u32(out, static_cast<uint32_t>(statements.size()));
+    out.append(reinterpret_cast<const char*>(statements.data()),
+               statements.size() * sizeof(AtomicStatement));
+    return out;
+}
+
+static bool deserialize_compiled(const std::string& data, const std::string& digest,
+                                 uint32_t& errors, SymbolTable& syms,
+                                 std::vector<AtomicStatement>& statements) {
+    size_t pos = 0;
+    auto u32 = [&](uint32_t& v) {
+        if (data.size() - pos < sizeof(v))
+            return false;
+        memcpy(&v, data.data() + pos, sizeof(v));
+        pos += sizeof(v);
+        return true;
+    };
+
+    uint32_t magic, version, nsyms, count;
+    if (!u32(magic) || !u32(version) || magic != CACHE_MAGIC || version != CACHE_VERSION)
+        return false;
+    if (data.compare(pos, digest.size(), digest) != 0)
+        return false;
+    pos += digest.size();
+    if (!u32(errors) || !u32(nsyms))
+        return false;
+
+    // Interning the names in their original order reproduces the original handles
+    for (Sym sym = SYM_ALL + 1; sym < nsyms; sym++) {
+        uint32_t len;
+        if (!u32(len) || data.size() - pos < len)
+            return false;
+        if (syms.intern(data.substr(pos, len)) != sym)
+            return false;
+        pos += len;
+    }
+
+    if (!u32(count) || data.size() - pos != size_t{count} * sizeof(AtomicStatement))
+        return false;
+    statements.resize(count);
+    memcpy(statements.data(), data.data() + pos, count * sizeof(AtomicStatement));
+    for (const auto& stmt : statements) {
+        for (Sym sym : stmt.sepol) {
+            if (sym >= nsyms)
+                return false;
+        }
+    }
+    return true;
+}
+
+int sepolicy_apply_compiled(const std::string& set_name,
+                            const std::vector<SepolicySource>& sources) {
+    std::string cache_path = std::string(SEPOLICY_CACHE_DIR) + set_name;
+    std::string digest = sources_digest(sources);
+
+    SymbolTable syms;
+    std::vector<AtomicStatement> statements;
+    uint32_t errors = 0;
+    auto cached = read_file(cache_path);
+    if (cached && deserialize_compiled(*cached, digest, errors, syms, statements)) {
+        LOGI("sepolicy %s: %zu statements from cache", set_name.c_str(), statements.size());
+    } else {
+        // A failed cache read may have left names behind
+        syms.clear();
+        statements.clear();
+        auto collect = [&](const AtomicStatement& stmt) { statements.push_back(stmt); };
+        for (const auto& src : sources) {
+            int failed = parse_policy(src.rules, syms, collect);
+            if (failed > 0)
+                LOGW("sepolicy %s: %d invalid rules in %s", set_name.c_str(), failed,
+                     src.name.c_str());
+            errors += static_cast<uint32_t>(failed);
+        }
+        size_t removed = dedupe_statements(statements);
+        LOGI("sepolicy %s: compiled %zu statements (%zu names) from %zu sources, "
+             "%zu duplicates removed",
+             set_name.c_str(), statements.size(), syms.size() - 2, sources.size(), removed);
+
+        std::string tmp = cache_path + ".tmp";
+        if (!ensure_dir_exists(SEPOLICY_CACHE_DIR) ||
+            !write_file(tmp, serialize_compiled(digest, errors, syms, statements)) ||
+            rename(tmp.c_str(), cache_path.c_str()) != 0) {
+            LOGW("Failed to save compiled sepolicy %s: %s", set_name.c_str(), strerror(errno));
+            unlink(tmp.c_str());
+        }
+    }
+
+    int failed = static_cast<int>(errors);
+    for (const auto& stmt : statements) {
+        if (apply_statement(stmt, syms) < 0)
+            failed++;
+    }
+    return failed > 0 ? 1 : 0;
 }
 
 int sepolicy_apply_file(const std::string& file) {
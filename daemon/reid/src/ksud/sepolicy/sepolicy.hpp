@@ -1,11 +1,27 @@
 #pragma once
 
 #include <string>
+#include <vector>
 
 namespace ksud {
 
 int sepolicy_live_patch(const std::string& policy);
 int sepolicy_apply_file(const std::string& file);
 int sepolicy_check_rule(const std::string& policy);
+// Apply each rule on its own; returns how many applied without error
+int sepolicy_live_patch_batch(const std::vector<std::string>& rules);
+
+// A named block of rule text, e.g. one module's sepolicy.rule
+struct SepolicySource {
+    std::string name;
+    std::string rules;
+};
+
+// Parse all sources into one list of atomic statements, drop statements that would not change
+// the policy, and apply the rest. The compiled list is cached as SEPOLICY_CACHE_DIR/<set_name>
+// together with a hash of the sources, so later boots with unchanged inputs skip parsing.
+// Returns 0 when every rule parsed and applied.
+int sepolicy_apply_compiled(const std::string& set_name,
+                            const std::vector<SepolicySource>& sources);
 
 }  // namespace ksud
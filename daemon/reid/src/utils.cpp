@@ -1,18 +1,24 @@
 #include "utils.hpp"
 #include "ksud/boot/boot_patch.hpp"
 #include "core/assets.hpp"
+#include "core/boot_trace.hpp"
 #include "ksud/ksucalls.hpp"
 #include "core/allowlist.hpp"
 #include "core/restorecon.hpp"
 #include "defs.hpp"
 #include "log.hpp"
+#include "miniz.h"
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <linux/fs.h>
 #include <sys/mount.h>
+#include <sys/resource.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/wait.h>
 #include <unistd.h>
+#include <algorithm>
 #include <cstring>
 #include <filesystem>
 #include <fstream>
@@ -21,13 +27,10 @@
 #ifdef __ANDROID__
 #include <sys/system_properties.h>
 #endif // #ifdef __ANDROID__
-#ifdef USE_LIBZIP
-#include <zip.h>
-#endif // #ifdef USE_LIBZIP
 
 namespace ksud {
 
-bool ensure_dir_exists(const std::string& path) {
+bool mkdirs(const std::string& path, mode_t mode) {
     struct stat st;
     if (stat(path.c_str(), &st) == 0) {
         return S_ISDIR(st.st_mode);
@@ -38,14 +41,14 @@ bool ensure_dir_exists(const std::string& path) {
     for (char c : path) {
         current += c;
         if (c == '/' && !current.empty()) {
-            if (mkdir(current.c_str(), 0755) != 0 && errno != EEXIST) {
+            if (mkdir(current.c_str(), mode) != 0 && errno != EEXIST) {
                 LOGE("Failed to create directory %s: %s", current.c_str(), strerror(errno));
                 return false;
             }
         }
     }
 
-    if (mkdir(path.c_str(), 0755) != 0 && errno != EEXIST) {
+    if (mkdir(path.c_str(), mode) != 0 && errno != EEXIST) {
         LOGE("Failed to create directory %s: %s", path.c_str(), strerror(errno));
         return false;
     }
@@ -53,14 +56,187 @@ bool ensure_dir_exists(const std::string& path) {
     return true;
 }
 
+bool ensure_dir_exists(const std::string& path) {
+    return mkdirs(path, 0755);
+}
+
+// Remove `name` below dirfd; directories are emptied through their own fd first
+static bool remove_tree_at(int dir_fd, const char* name, bool maybe_dir) {
+    if (!maybe_dir) {
+        if (unlinkat(dir_fd, name, 0) == 0 || errno == ENOENT)
+            return true;
+        if (errno != EISDIR && errno != EPERM)
+            return false;
+    }
+
+    int fd = openat(dir_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == ENOENT)
+            return true;
+        // Not a directory after all (d_type was unknown or lied)
+        if (errno == ENOTDIR || errno == ELOOP)
+            return unlinkat(dir_fd, name, 0) == 0 || errno == ENOENT;
+        return false;
+    }
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        close(fd);
+        return false;
+    }
+
+    bool ok = true;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
+            continue;
+        bool child_maybe_dir = entry->d_type == DT_DIR || entry->d_type == DT_UNKNOWN;
+        if (!remove_tree_at(dirfd(dir), entry->d_name, child_maybe_dir)) {
+            ok = false;
+        }
+    }
+    closedir(dir);
+
+    if (unlinkat(dir_fd, name, AT_REMOVEDIR) != 0 && errno != ENOENT) {
+        ok = false;
+    }
+    return ok;
+}
+
+bool remove_tree(const std::string& path) {
+    std::string target = path;
+    while (target.size() > 1 && target.back() == '/')
+        target.pop_back();
+    if (target.empty())
+        return false;
+
+    if (!remove_tree_at(AT_FDCWD, target.c_str(), false)) {
+        LOGW("Failed to remove %s: %s", target.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+bool copy_file_atomic(const std::string& src, const std::string& dst) {
+    int in = open(src.c_str(), O_RDONLY | O_CLOEXEC);
+    if (in < 0) {
+        LOGE("Failed to open %s: %s", src.c_str(), strerror(errno));
+        return false;
+    }
+    struct stat st;
+    if (fstat(in, &st) != 0) {
+        close(in);
+        return false;
+    }
+
+    std::string tmp = dst + ".tmp";
+    int out = open(tmp.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, st.st_mode & 07777);
+    if (out < 0) {
+        LOGE("Failed to create %s: %s", tmp.c_str(), strerror(errno));
+        close(in);
+        return false;
+    }
+
+    bool ok = true;
+    char buf[64 * 1024];
+    ssize_t n;
+    while ((n = read(in, buf, sizeof(buf))) != 0) {
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            ok = false;
+            break;
+        }
+        ssize_t off = 0;
+        while (off < n) {
+            ssize_t w = write(out, buf + off, n - off);
+            if (w < 0 && errno == EINTR)
+                continue;
+            if (w <= 0) {
+                ok = false;
+                break;
+            }
+            off += w;
+        }
+        if (!ok)
+            break;
+    }
+    close(in);
+
+    ok = ok && fchmod(out, st.st_mode & 07777) == 0 && fsync(out) == 0;
+    ok = (close(out) == 0) && ok;
+    if (!ok || rename(tmp.c_str(), dst.c_str()) != 0) {
+        LOGE("Failed to copy %s to %s: %s", src.c_str(), dst.c_str(), strerror(errno));
+        unlink(tmp.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool touch_file(const std::string& path) {
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_NOCTTY | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        LOGW("Failed to touch %s: %s", path.c_str(), strerror(errno));
+        return false;
+    }
+    bool ok = futimens(fd, nullptr) == 0;
+    close(fd);
+    return ok;
+}
+
+bool exchange_paths(const std::string& a, const std::string& b) {
+    // bionic only wraps renameat2 from API 30, go through the syscall directly
+    if (syscall(__NR_renameat2, AT_FDCWD, a.c_str(), AT_FDCWD, b.c_str(), RENAME_EXCHANGE) != 0) {
+        LOGW("Failed to exchange %s and %s: %s", a.c_str(), b.c_str(), strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+void remove_tree_async(const std::vector<std::string>& paths, int inherit_fd) {
+    if (paths.empty())
+        return;
+    // Everything the child needs is built here: after fork() in a multithreaded process only
+    // async-signal-safe calls are allowed until exec
+    std::vector<const char*> argv = {"rm", "-rf", "--"};
+    for (const auto& p : paths)
+        argv.push_back(p.c_str());
+    argv.push_back(nullptr);
+
+    pid_t pid = fork();
+    if (pid < 0) {
+        for (const auto& p : paths)
+            remove_tree(p);
+        return;
+    }
+    if (pid > 0) {
+        waitpid(pid, nullptr, 0);
+        return;
+    }
+
+    // Double fork so the worker is reparented to init and never left as our zombie
+    if (fork() != 0) {
+        _exit(0);
+    }
+    setsid();
+    if (inherit_fd >= 0)
+        fcntl(inherit_fd, F_SETFD, 0);
+    // Idle I/O class and lowest CPU priority, this must not compete with boot
+    constexpr int IOPRIO_CLASS_IDLE = 3;
+    constexpr int IOPRIO_CLASS_SHIFT = 13;
+    constexpr int IOPRIO_WHO_PROCESS = 1;
+    syscall(__NR_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_CLASS_IDLE << IOPRIO_CLASS_SHIFT);
+    setpriority(PRIO_PROCESS, 0, 19);
+    execv("/system/bin/rm", const_cast<char* const*>(argv.data()));
+    _exit(127);
+}
+
 bool ensure_clean_dir(const std::string& path) {
     LOGD("ensure_clean_dir: %s", path.c_str());
 
     struct stat st;
-    if (stat(path.c_str(), &st) == 0) {
+    if (lstat(path.c_str(), &st) == 0) {
         // Remove existing directory
-        std::string cmd = "rm -rf " + path;
-        system(cmd.c_str());
+        remove_tree(path);
     }
 
     return ensure_dir_exists(path);
@@ -136,6 +312,99 @@ std::optional<std::string> getprop(const std::string& prop) {
 #endif // #ifdef __ANDROID__
 }
 
+void PropSnapshot::refresh() {
+    props_.clear();
+#ifdef __ANDROID__
+    __system_property_foreach(
+        [](const prop_info* pi, void* cookie) {
+            // The read callback also returns values longer than PROP_VALUE_MAX (ro.* props)
+            __system_property_read_callback(
+                pi,
+                [](void* cookie, const char* name, const char* value, uint32_t) {
+                    static_cast<std::unordered_map<std::string, std::string>*>(cookie)->emplace(
+                        name, value);
+                },
+                cookie);
+        },
+        &props_);
+#else
+    // "[name]: [value]" per line
+    auto result = exec_command({"getprop"});
+    std::istringstream iss(result.stdout_str);
+    std::string line;
+    while (std::getline(iss, line)) {
+        size_t name_end = line.find("]: [");
+        if (line.size() < 6 || line[0] != '[' || name_end == std::string::npos ||
+            line.back() != ']')
+            continue;
+        props_.emplace(line.substr(1, name_end - 1),
+                       line.substr(name_end + 4, line.size() - name_end - 5));
+    }
+#endif // #ifdef __ANDROID__
+}
+
+std::optional<std::string> PropSnapshot::get(const std::string& name) const {
+    auto it = props_.find(name);
+    if (it == props_.end())
+        return std::nullopt;
+    return it->second;
+}
+
+std::string PropSnapshot::get_or(const std::string& name, const std::string& fallback) const {
+    auto it = props_.find(name);
+    return it == props_.end() ? fallback : it->second;
+}
+
+PropSnapshot& prop_snapshot() {
+    static PropSnapshot snapshot;
+    return snapshot;
+}
+
+bool resetprop_batch(const std::vector<std::pair<std::string, std::string>>& props) {
+    if (props.empty())
+        return true;
+
+    std::string content;
+    for (const auto& [key, value] : props)
+        content += key + "=" + value + "\n";
+
+    // The file only lives in memory; resetprop reads it back through /proc/self/fd
+    int fd = static_cast<int>(syscall(__NR_memfd_create, "system.prop", 0u));
+    bool batched = false;
+    if (fd >= 0) {
+        const char* p = content.data();
+        size_t left = content.size();
+        while (left > 0) {
+            ssize_t n = write(fd, p, left);
+            if (n < 0 && errno == EINTR)
+                continue;
+            if (n <= 0)
+                break;
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+        if (left == 0) {
+            std::string path = "/proc/self/fd/" + std::to_string(fd);
+            auto result = exec_command({RESETPROP_PATH, "-n", "--file", path});
+            batched = result.exit_code == 0;
+            if (!batched) {
+                LOGW("resetprop --file failed (%d): %s", result.exit_code,
+                     trim(result.stderr_str).c_str());
+            }
+        }
+        close(fd);
+    }
+    if (batched)
+        return true;
+
+    bool ok = true;
+    for (const auto& [key, value] : props) {
+        if (exec_command({RESETPROP_PATH, "-n", key, value}).exit_code != 0)
+            ok = false;
+    }
+    return ok;
+}
+
 bool is_safe_mode() {
     auto persist_safemode = getprop("persist.sys.safemode");
     if (persist_safemode && *persist_safemode == "1") {
@@ -303,6 +572,7 @@ ExecResult exec_command(const std::vector<std::string>& args) {
         return result;
     }
 
+    int64_t start_ns = trace_now_ns();
     pid_t pid = fork();
     if (pid < 0) {
         close(stdout_pipe[0]);
@@ -350,7 +620,9 @@ ExecResult exec_command(const std::vector<std::string>& args) {
     close(stderr_pipe[0]);
 
     int status;
-    waitpid(pid, &status, 0);
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    trace_child(args[0], pid, start_ns, &usage);
     if (WIFEXITED(status)) {
         result.exit_code = WEXITSTATUS(status);
     }
@@ -369,6 +641,7 @@ ExecResult exec_command(const std::vector<std::string>& args, const std::string&
         return result;
     }
 
+    int64_t start_ns = trace_now_ns();
     pid_t pid = fork();
     if (pid < 0) {
         close(stdout_pipe[0]);
@@ -423,7 +696,9 @@ ExecResult exec_command(const std::vector<std::string>& args, const std::string&
     close(stderr_pipe[0]);
 
     int status;
-    waitpid(pid, &status, 0);
+    struct rusage usage;
+    wait4(pid, &status, 0, &usage);
+    trace_child(args[0], pid, start_ns, &usage);
     if (WIFEXITED(status)) {
         result.exit_code = WEXITSTATUS(status);
     }
@@ -654,34 +929,33 @@ int uninstall(const std::optional<std::string>& magiskboot_path) {
     return 0;
 }
 
-uint64_t get_zip_uncompressed_size(const std::string& zip_path) {
-#ifdef USE_LIBZIP
-    zip_t* za = zip_open(zip_path.c_str(), ZIP_RDONLY, nullptr);
-    if (!za) {
-        LOGE("Failed to open ZIP: %s", zip_path.c_str());
-        return 0;
+std::optional<ZipSizeInfo> get_zip_size_info(const std::string& zip_path) {
+    mz_zip_archive za;
+    mz_zip_zero_struct(&za);
+    if (!mz_zip_reader_init_file(&za, zip_path.c_str(), 0)) {
+        LOGE("Failed to open ZIP: %s (%s)", zip_path.c_str(),
+             mz_zip_get_error_string(mz_zip_get_last_error(&za)));
+        return std::nullopt;
     }
 
-    uint64_t total = 0;
-    zip_int64_t num_entries = zip_get_num_entries(za, 0);
-
-    for (zip_int64_t i = 0; i < num_entries; i++) {
-        zip_stat_t stat;
-        if (zip_stat_index(za, i, 0, &stat) == 0) {
-            total += stat.size;
-        }
+    ZipSizeInfo info;
+    mz_uint num_entries = mz_zip_reader_get_num_files(&za);
+    for (mz_uint i = 0; i < num_entries; i++) {
+        mz_zip_archive_file_stat st;
+        if (!mz_zip_reader_file_stat(&za, i, &st) || st.m_is_directory)
+            continue;
+        info.total += st.m_uncomp_size;
+        info.files++;
+        info.largest = std::max<uint64_t>(info.largest, st.m_uncomp_size);
     }
 
-    zip_close(za);
-    return total;
-#else
-    // Fallback: estimate based on file size * 2
-    std::ifstream ifs(zip_path, std::ios::binary | std::ios::ate);
-    if (!ifs) {
-        return 0;
-    }
-    return static_cast<uint64_t>(ifs.tellg()) * 2;
-#endif // #ifdef USE_LIBZIP
+    mz_zip_reader_end(&za);
+    return info;
+}
+
+uint64_t get_zip_uncompressed_size(const std::string& zip_path) {
+    auto info = get_zip_size_info(zip_path);
+    return info ? info->total : 0;
 }
 
 }  // namespace ksud
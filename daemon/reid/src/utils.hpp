@@ -4,6 +4,9 @@
 #include <functional>
 #include <optional>
 #include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 
 namespace ksud {
 
@@ -14,8 +17,43 @@ bool ensure_file_exists(const std::string& path);
 bool ensure_binary(const std::string& path, const uint8_t* data, size_t size,
                    bool ignore_if_exist = false);
 
+// Native replacements for rm -rf / mkdir -p / cp -f / touch, no subprocess involved
+// Remove path recursively (fd-relative, never follows symlinks); a missing path is success
+bool remove_tree(const std::string& path);
+// Create directory and all missing parents
+bool mkdirs(const std::string& path, mode_t mode = 0755);
+// Copy through a temp file that is fsync'ed and renamed over dst, keeping src's mode
+bool copy_file_atomic(const std::string& src, const std::string& dst);
+// Create an empty file or update its timestamps
+bool touch_file(const std::string& path);
+// Atomically swap two existing paths on the same filesystem (renameat2 RENAME_EXCHANGE)
+bool exchange_paths(const std::string& a, const std::string& b);
+// `rm -rf` the paths in a detached idle-priority process; returns without waiting for it. The
+// forked child only execs, so this is safe from a multithreaded caller. inherit_fd, if set, is
+// left open in rm, e.g. to hold a flock until the removal finishes.
+void remove_tree_async(const std::vector<std::string>& paths, int inherit_fd = -1);
+
 // Property utilities
 std::optional<std::string> getprop(const std::string& prop);
+// All system properties read at once, then served from memory until refresh()
+class PropSnapshot {
+public:
+    PropSnapshot() { refresh(); }
+    // Reload: __system_property_foreach on Android, otherwise one parsed `getprop` dump
+    void refresh();
+    std::optional<std::string> get(const std::string& name) const;
+    std::string get_or(const std::string& name, const std::string& fallback = "") const;
+    size_t size() const { return props_.size(); }
+
+private:
+    std::unordered_map<std::string, std::string> props_;
+};
+// Process-wide snapshot for helpers that query the same few properties repeatedly; callers
+// that change properties refresh it
+PropSnapshot& prop_snapshot();
+// Set properties (skipping property_service, like resetprop -n) with a single resetprop --file
+// call; falls back to one call per property if that fails
+bool resetprop_batch(const std::vector<std::pair<std::string, std::string>>& props);
 bool is_safe_mode();
 
 // Process utilities
@@ -34,6 +72,13 @@ int uninstall(const std::optional<std::string>& magiskboot_path);
 int set_root_impl(const std::string& impl);
 
 // Zip utilities
+struct ZipSizeInfo {
+    uint64_t total = 0;    // sum of uncompressed member sizes
+    size_t files = 0;      // regular members, directories excluded
+    uint64_t largest = 0;  // biggest single member
+};
+// Read from the central directory only, nothing is inflated
+std::optional<ZipSizeInfo> get_zip_size_info(const std::string& zip_path);
 uint64_t get_zip_uncompressed_size(const std::string& zip_path);
 
 // String utilities